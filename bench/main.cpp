@@ -0,0 +1,376 @@
+/**
+ * @file main.cpp
+ * @brief Benchmarks of lect on synthetic inputs. They are only built with
+ * `-DLECT_BENCHMARKS=ON`, and print the time of every step and the peak
+ * resident set size of the process after it. Without arguments, every
+ * benchmark is run in a process of its own, so that the peaks don't carry
+ * over from one benchmark to another
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "checks.hpp"
+#include "diagnostics.hpp"
+#include "export.hpp"
+#include "graph.hpp"
+#include "highlight.hpp"
+#include "html.hpp"
+#include "json_writer.hpp"
+#include "nlohmann/json.hpp"
+#include "preprocessing.hpp"
+#include "scan.hpp"
+#include "structures.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/**
+ * @brief Peak resident set size of the process so far
+ *
+ * @return Size in KiB
+ */
+long peak_rss_kib() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+/**
+ * @brief Runs a benchmark once and prints how long it took
+ *
+ * @tparam F Function type
+ * @param name Name of the benchmark
+ * @param benchmark Function to time
+ */
+template <typename F> void run(const std::string &name, F &&benchmark) {
+    auto start = std::chrono::steady_clock::now();
+    benchmark();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << std::left << std::setw(44) << name << std::right
+              << std::fixed << std::setprecision(1) << std::setw(10)
+              << elapsed.count() << " ms" << std::setw(8)
+              << peak_rss_kib() / 1024 << " MiB peak RSS\n";
+}
+
+/**
+ * @brief Keeps the results of the benchmarks from being optimized away
+ */
+volatile std::size_t sink;
+
+/**
+ * @brief Generates text annotations whose contents are a kibibyte of prose,
+ * every one referencing a few later annotations, so that the reference graph
+ * has no cycles
+ *
+ * @param count Number of annotations
+ * @param references Number of references of every annotation
+ * @return Annotations
+ */
+lect::Annotations synthetic_annotations(std::size_t count,
+                                        std::size_t references) {
+    lect::Annotations annotations;
+    annotations.text_annotations.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        lect::TextAnnotation annotation;
+        annotation.id = "a" + std::to_string(i);
+        annotation.title = "Annotation " + std::to_string(i);
+        annotation.file = "bench/" + std::to_string(i % 100) + "/" +
+                          annotation.id + ".an";
+        for (std::size_t r = 1; r <= references && i + r * r < count; r++) {
+            std::string id = "a" + std::to_string(i + r * r);
+            annotation.content += "This paragraph explains a part of the "
+                                  "design, with \"quotes\" & <markup>, and "
+                                  "continues at $" +
+                                  id + ".\n";
+            annotation.references.push_back(id);
+            annotation.reference_lines.push_back(r);
+        }
+        while (annotation.content.size() < 1024) {
+            annotation.content += "It goes on with a line that has no "
+                                  "references.\n";
+        }
+        annotations.text_annotations.push_back(std::move(annotation));
+    }
+    return annotations;
+}
+
+/**
+ * @brief Builds the payload as a JSON document, the way the export did
+ * before it streamed the payload. The document is the same as the one that
+ * write_payload() streams
+ *
+ * @param payload Payload to convert
+ * @return JSON document
+ */
+nlohmann::json dom_payload(const lect::Payload &payload) {
+    using nlohmann::json;
+    json code = json::array();
+    for (const auto &a : payload.annotations.code_annotations) {
+        code.push_back(json{{"file", a.file},
+                            {"html", lect::highlight_html(a)},
+                            {"id", a.id},
+                            {"line", a.line},
+                            {"title", a.title}});
+    }
+    json text = json::array();
+    for (const auto &a : payload.annotations.text_annotations) {
+        std::vector<std::string> references = a.references;
+        std::sort(references.begin(), references.end());
+        references.erase(std::unique(references.begin(), references.end()),
+                         references.end());
+        text.push_back(json{{"html", lect::text_html(a)},
+                            {"id", a.id},
+                            {"references", references},
+                            {"title", a.title}});
+    }
+    return json{{"code_annotations", code},
+                {"graph",
+                 {{"offsets", payload.graph_offsets},
+                  {"targets", payload.graph_targets}}},
+                {"text_annotations", text}};
+}
+
+/**
+ * @brief Times writing the annotations of a synthetic project into
+ * annotations.js, either streamed through JsonWriter or built as a
+ * nlohmann::json document and dumped into a string first, as the export used
+ * to. Both write the same file
+ *
+ * @param dom Whether to build the document instead of streaming
+ * @param megabytes Size of the contents of the annotations in MiB
+ */
+void bench_payload(bool dom, std::size_t megabytes) {
+    lect::Payload payload;
+    run("input, " + std::to_string(megabytes) + " MiB", [&]() {
+        payload.annotations = synthetic_annotations(megabytes * 1024, 3);
+        lect::AnnotationGraph graph =
+            lect::AnnotationGraph::build(payload.annotations);
+        payload.graph_offsets = graph.offsets;
+        payload.graph_targets = graph.targets;
+    });
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() /
+                                 (dom ? "lect-bench-dom.js"
+                                      : "lect-bench-stream.js");
+    run(dom ? "nlohmann::json and dump()" : "JsonWriter", [&]() {
+        std::ofstream file(path, std::ios::binary);
+        if (dom) {
+            file << "const annotationsJSON = " + dom_payload(payload).dump();
+        } else {
+            file << "const annotationsJSON = ";
+            lect::JsonWriter writer(&file);
+            lect::write_payload(writer, payload);
+        }
+    });
+    std::cout << "annotations.js: "
+              << std::filesystem::file_size(path) / (1024 * 1024) << " MiB\n";
+    std::filesystem::remove(path);
+}
+
+/**
+ * @brief Collects the references of a content the way extraction did before
+ * scan.hpp, with `find('$')` and `find_first_not_of()` over the characters of
+ * IDs
+ *
+ * @param content Content to look in
+ * @param references References found
+ */
+void previous_scan(const std::string &content,
+                   std::vector<std::string> &references) {
+    std::size_t next_pos = content.find('$');
+    while (next_pos != std::string::npos && next_pos < content.size()) {
+        std::size_t end_pos = content.find_first_not_of(
+            "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ-",
+            next_pos + 1);
+        references.push_back(
+            content.substr(next_pos + 1, end_pos - next_pos - 1));
+        next_pos = content.find('$', end_pos);
+    }
+}
+
+/**
+ * @brief Times collecting the references of a large content with
+ * scan_references(), the way extraction does, against the scan it replaced.
+ * The content has a reference in every line, or no references at all. Every
+ * scan goes over the content ten times
+ *
+ * @param size Size of the content in bytes
+ */
+void bench_scanner(std::size_t size) {
+    std::string line = "Prose that explains the design and refers to "
+                       "$some-annotation once.\n";
+    std::string references;
+    while (references.size() < size) {
+        references += line;
+    }
+    std::string prose(references.size(), 'x');
+    std::string megabytes = std::to_string(size >> 20) + " MiB";
+
+    auto scan = [&megabytes](const std::string &name,
+                             const std::string &content) {
+        run("scan_references, " + name + ", " + megabytes, [&content]() {
+            std::size_t found = 0;
+            for (int i = 0; i < 10; i++) {
+                std::vector<std::string> references;
+                lect::scan_references(
+                    content, [&references](std::string_view ref, std::size_t) {
+                        references.emplace_back(ref);
+                    });
+                found += references.size();
+            }
+            sink = found;
+        });
+        run("previous scan, " + name + ", " + megabytes, [&content]() {
+            std::size_t found = 0;
+            for (int i = 0; i < 10; i++) {
+                std::vector<std::string> references;
+                previous_scan(content, references);
+                found += references.size();
+            }
+            sink = found;
+        });
+    };
+    scan("references", references);
+    scan("no references", prose);
+}
+
+/**
+ * @brief Generates text annotations without any content besides their
+ * references
+ *
+ * @param children Numbers of the annotations that every annotation references
+ * @return Annotations
+ */
+lect::Annotations
+graph_annotations(const std::vector<std::vector<uint32_t>> &children) {
+    lect::Annotations annotations;
+    annotations.text_annotations.reserve(children.size());
+    for (std::size_t i = 0; i < children.size(); i++) {
+        lect::TextAnnotation annotation;
+        annotation.id = "a" + std::to_string(i);
+        for (uint32_t child : children[i]) {
+            annotation.references.push_back("a" + std::to_string(child));
+            annotation.content += "$" + annotation.references.back() + "\n";
+        }
+        annotations.text_annotations.push_back(std::move(annotation));
+    }
+    return annotations;
+}
+
+/**
+ * @brief Times the cycle checker on a deep chain that closes into a single
+ * cycle, and on a chain of diamonds without cycles, which has a number of
+ * paths exponential in its depth
+ *
+ * @param depth Length of the chain
+ * @param diamonds Number of diamonds
+ */
+void bench_cycles(uint32_t depth, uint32_t diamonds) {
+    std::vector<std::vector<uint32_t>> chain(depth);
+    for (uint32_t i = 0; i < depth; i++) {
+        chain[i].push_back((i + 1) % depth);
+    }
+
+    // Every diamond is a node that references two nodes, which both
+    // reference the top of the next diamond
+    std::vector<std::vector<uint32_t>> lattice(diamonds * 3 + 1);
+    for (uint32_t i = 0; i < diamonds; i++) {
+        lattice[i * 3] = {i * 3 + 1, i * 3 + 2};
+        lattice[i * 3 + 1] = {i * 3 + 3};
+        lattice[i * 3 + 2] = {i * 3 + 3};
+    }
+
+    for (const auto &[name, children] :
+         {std::make_pair("chain, " + std::to_string(depth) + " nodes", &chain),
+          std::make_pair("diamonds, " + std::to_string(diamonds) + " levels",
+                         &lattice)}) {
+        lect::Annotations annotations = graph_annotations(*children);
+        lect::AnnotationGraph graph = lect::AnnotationGraph::build(annotations);
+        lect::CycleChecker checker;
+        lect::Diagnostics diagnostics;
+        run("cycles, " + name, [&]() {
+            checker.check(annotations, graph, diagnostics);
+            sink = diagnostics.size();
+        });
+    }
+}
+
+/**
+ * @brief Runs a benchmark in a process of its own
+ *
+ * @param program Path of this program
+ * @param arguments Arguments that select the benchmark
+ * @return Whether the benchmark succeeded
+ */
+bool run_process(const std::string &program, const std::string &arguments) {
+    std::cout << "== " << arguments << std::endl;
+    return std::system(("\"" + program + "\" " + arguments).c_str()) == 0;
+}
+
+int main(int argc, char **argv) {
+    std::string benchmark = argc > 1 ? argv[1] : "";
+    std::size_t megabytes = 500;
+    if (argc > 2) {
+        char *end;
+        megabytes = std::strtoul(argv[2], &end, 10);
+        if (*end != '\0' || megabytes == 0) {
+            benchmark = "usage";
+        }
+    }
+
+    try {
+        if (benchmark.empty()) {
+            std::string size = std::to_string(megabytes);
+            for (const std::string &arguments :
+                 {"stream " + size, "dom " + size, std::string("scanner"),
+                  std::string("cycles")}) {
+                if (!run_process(argv[0], arguments)) {
+                    return 1;
+                }
+            }
+        } else if (benchmark == "stream" || benchmark == "dom") {
+            bench_payload(benchmark == "dom", megabytes);
+        } else if (benchmark == "scanner") {
+            bench_scanner(std::size_t(64) << 20);
+        } else if (benchmark == "cycles") {
+            bench_cycles(500000, 10000);
+        } else {
+            std::cout << "Usage: lect_bench [stream <MiB> | dom <MiB> | "
+                         "scanner | cycles]\n"
+                         "  Without arguments, runs every benchmark, the "
+                         "payload ones with 500 MiB\n";
+            return 1;
+        }
+    } catch (lect::Exception e) {
+        std::cout << lect::color_red + "ERROR: " + lect::color_reset + e.what()
+                  << "\n";
+        return 1;
+    }
+    return 0;
+}
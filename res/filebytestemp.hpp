@@ -0,0 +1,5 @@
+#pragma once
+
+constexpr unsigned char @BYTES_NAME@[] = {
+@FILE_BYTES@
+};
@@ -1,7 +1,10 @@
 #pragma once
 
-#include <string>
+#include <string_view>
 
-const char * @STR_NAME@ = R"delimiter(
+constexpr char @STR_NAME@_data[] = R"delimiter(
 @FILE_CONTENT@
 )delimiter";
+
+constexpr std::string_view @STR_NAME@(@STR_NAME@_data,
+                                      sizeof(@STR_NAME@_data) - 1);
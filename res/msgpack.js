@@ -0,0 +1,109 @@
+"use strict";
+
+// Decodes MessagePack, supporting every type but binary data and extensions
+function decodeMessagePack(bytes) {
+    let view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+    let decoder = new TextDecoder();
+    let pos = 0;
+
+    function read(size, get) {
+        let result = get.call(view, pos);
+        pos += size;
+        return result;
+    }
+    function string(length) {
+        let end = pos + length;
+        // TextDecoder has a large overhead for short strings, so short ASCII
+        // strings are decoded by hand
+        if (length < 64) {
+            let result = "";
+            for (let i = pos; i < end; i++) {
+                if (bytes[i] >= 0x80) {
+                    result = undefined;
+                    break;
+                }
+                result += String.fromCharCode(bytes[i]);
+            }
+            if (result !== undefined) {
+                pos = end;
+                return result;
+            }
+        }
+        let result = decoder.decode(bytes.subarray(pos, end));
+        pos = end;
+        return result;
+    }
+    function array(length) {
+        let result = new Array(length);
+        for (let i = 0; i < length; i++) {
+            result[i] = value();
+        }
+        return result;
+    }
+    function map(length) {
+        let result = {};
+        for (let i = 0; i < length; i++) {
+            let key = value();
+            result[key] = value();
+        }
+        return result;
+    }
+    function value() {
+        let type = bytes[pos++];
+        if (type < 0x80) return type;
+        if (type < 0x90) return map(type & 0x0f);
+        if (type < 0xa0) return array(type & 0x0f);
+        if (type < 0xc0) return string(type & 0x1f);
+        if (type >= 0xe0) return type - 0x100;
+        switch (type) {
+            case 0xc0: return null;
+            case 0xc2: return false;
+            case 0xc3: return true;
+            case 0xca: return read(4, view.getFloat32);
+            case 0xcb: return read(8, view.getFloat64);
+            case 0xcc: return read(1, view.getUint8);
+            case 0xcd: return read(2, view.getUint16);
+            case 0xce: return read(4, view.getUint32);
+            case 0xcf: return Number(read(8, view.getBigUint64));
+            case 0xd0: return read(1, view.getInt8);
+            case 0xd1: return read(2, view.getInt16);
+            case 0xd2: return read(4, view.getInt32);
+            case 0xd3: return Number(read(8, view.getBigInt64));
+            case 0xd9: return string(read(1, view.getUint8));
+            case 0xda: return string(read(2, view.getUint16));
+            case 0xdb: return string(read(4, view.getUint32));
+            case 0xdc: return array(read(2, view.getUint16));
+            case 0xdd: return array(read(4, view.getUint32));
+            case 0xde: return map(read(2, view.getUint16));
+            case 0xdf: return map(read(4, view.getUint32));
+        }
+        throw new Error("Unsupported MessagePack type " + type);
+    }
+    return value();
+}
+
+// annotations.js either defines annotationsJSON itself, or, with
+// `-format msgpack`, names the MessagePack file the annotations are in. The
+// file is fetched and decoded before the viewer starts
+function loadAnnotations() {
+    if (typeof annotationsJSON !== "undefined") {
+        return Promise.resolve();
+    }
+    return fetch(annotationsMessagePack)
+        .then((response) => response.arrayBuffer())
+        .then((buffer) => {
+            window.annotationsJSON = decodeMessagePack(new Uint8Array(buffer));
+        });
+}
+
+function startViewer() {
+    loadAnnotations().then(() => {
+        let script = document.createElement("script");
+        script.src = "script.js";
+        document.body.appendChild(script);
+    }).catch(() => {
+        document.querySelector("#control").innerHTML =
+            "<p>Couldn't load the annotations. Documentation exported with " +
+            "<b>-format msgpack</b> has to be served over HTTP</p>";
+    });
+}
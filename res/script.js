@@ -36,6 +36,66 @@ for (let el of annotationsJSON.text_annotations) {
 }
 
 
+// Nodes are numbered with text annotations first, followed by code annotations,
+// like in the graph of the payload. The lookups below are built once, so
+// finding an annotation by its ID doesn't scan the annotations. An ID shared
+// by several annotations maps to the first one
+let nodeAnnotations = annotationsJSON.text_annotations
+    .concat(annotationsJSON.code_annotations);
+let textCount = annotationsJSON.text_annotations.length;
+let nodeIds = nodeAnnotations.map((annotation) => annotation.id);
+let nodeIndex = new Map();
+for (let [index, id] of nodeIds.entries()) {
+    if (!nodeIndex.has(id)) {
+        nodeIndex.set(id, index);
+    }
+}
+let graphOffsets = annotationsJSON.graph.offsets;
+let graphTargets = annotationsJSON.graph.targets;
+let reverseOffsets = new Uint32Array(nodeIds.length + 1);
+let reverseTargets = new Uint32Array(graphTargets.length);
+for (let target of graphTargets) {
+    reverseOffsets[target + 1]++;
+}
+for (let i = 0; i < nodeIds.length; i++) {
+    reverseOffsets[i + 1] += reverseOffsets[i];
+}
+let fill = reverseOffsets.slice(0, nodeIds.length);
+for (let node = 0; node < nodeIds.length; node++) {
+    for (let i = graphOffsets[node]; i < graphOffsets[node + 1]; i++) {
+        reverseTargets[fill[graphTargets[i]]++] = node;
+    }
+}
+
+// Collects the nodes reachable from start over the given graph
+function reachable(start, offsets, targets, found) {
+    let stack = [start];
+    let visited = new Uint8Array(nodeIds.length);
+    visited[start] = 1;
+    while (stack.length > 0) {
+        let node = stack.pop();
+        found.add(nodeIds[node]);
+        for (let i = offsets[node]; i < offsets[node + 1]; i++) {
+            if (!visited[targets[i]]) {
+                visited[targets[i]] = 1;
+                stack.push(targets[i]);
+            }
+        }
+    }
+}
+
+// IDs of the annotation itself, its ancestors and its descendants
+function connectedTo(nodeId) {
+    let connected = new Set();
+    let start = nodeIndex.get(nodeId);
+    if (start === undefined) {
+        return connected;
+    }
+    reachable(start, graphOffsets, graphTargets, connected);
+    reachable(start, reverseOffsets, reverseTargets, connected);
+    return connected;
+}
+
 let edges = [];
 
 for (let el of annotationsJSON.text_annotations) {
@@ -115,6 +175,31 @@ let options = {
     */
 };
 
+// lect lays the graph out when it exports it, so the nodes only have to be put
+// where it says
+if (annotationsJSON.layout !== undefined) {
+    for (let node of nodes) {
+        let index = nodeIndex.get(node.id);
+        node.x = annotationsJSON.layout.x[index];
+        node.y = annotationsJSON.layout.y[index];
+    }
+    options.layout = {
+        randomSeed: 0,
+        improvedLayout: false,
+        hierarchical: {
+            enabled: false
+        }
+    };
+}
+
+// Shadows cost a blur for every node and edge on every frame, which large
+// graphs can't afford
+let largeGraph = nodeIds.length > 1000;
+if (largeGraph) {
+    options.edges.shadow.enabled = false;
+    options.nodes.shadow.enabled = false;
+}
+
 let network = new vis.Network(container, data, options);
 
 let viewer = document.querySelector("#viewer");
@@ -163,49 +248,90 @@ function selectNode(nodeId) {
 
 }
 
-function displayNode(nodeId) {
-    let isCode = false;
-    let annotation = annotationsJSON.text_annotations
-        .find((annotation) => nodeId === annotation.id);
-    if (annotation === undefined) {
-        annotation = annotationsJSON.code_annotations
-            .find((annotation) => nodeId === annotation.id);
-        isCode = true;
+// With -shards, the contents of the annotations are left out of
+// annotationsJSON. They are in scripts named after the first digits of the
+// FNV-1a hash of the IDs, which call annotationContent() when they load
+let shardRequests = new Map();
+let encoder = new TextEncoder();
+
+function shardOf(id) {
+    let hash = 0x811c9dc5;
+    for (let byte of encoder.encode(id)) {
+        hash = Math.imul(hash ^ byte, 0x01000193) >>> 0;
     }
+    return hash.toString(16).padStart(8, "0").slice(0, annotationsJSON.shards);
+}
+
+function annotationContent(prefix, contents) {
+    shardRequests.get(prefix)?.resolve(contents);
+}
+
+function loadContent(annotation) {
+    let prefix = shardOf(annotation.id);
+    if (!shardRequests.has(prefix)) {
+        let request = {};
+        request.promise = new Promise((resolve, reject) => {
+            request.resolve = resolve;
+            let script = document.createElement("script");
+            script.src = "content/" + prefix + ".js";
+            script.onerror = () => {
+                script.remove();
+                reject();
+            };
+            document.body.appendChild(script);
+        });
+        shardRequests.set(prefix, request);
+    }
+    return shardRequests.get(prefix).promise.then((contents) => {
+        annotation.html = contents[annotation.id] ?? "";
+    });
+}
+
+// A shard that couldn't be loaded is forgotten, so displaying one of its
+// annotations again loads it again
+function showLoadError(annotation) {
+    shardRequests.delete(shardOf(annotation.id));
     viewer.style.display = "flex";
     viewer.querySelector("h4").textContent = annotation.id;
     viewer.querySelector("h1").textContent = annotation.title;
     viewer.querySelector(".file")?.remove();
     let content = viewer.querySelector(".content");
-    content.innerHTML = "";
-    let split = annotation.content.split("\n");
-    for(let line of split) {
-        if(!isCode) {
-            let refs = annotation.references;
-            for(let ref of refs) {
-                line = line.replace("$" + ref, 
-                    `<a href="#${ref}" onclick="onRefClick('${ref}')">$${ref}</a>`);
-            }
-
-        }
-        let pos = 0;
-        for(let char of line) {
-            if(char != " ") {
-                break;
-            }
-            pos++;
-        }
-        for(let i = 0; i < pos; i++) {
-            content.innerHTML += "&#x00A0";
-        }
-        content.innerHTML += line + "<br/>";
+    content.textContent = "Couldn't load the content of the annotation. " +
+        "Close this and display it again to retry.";
+    content.style.color = "red";
+    content.style.backgroundColor = "white";
+    content.style.overflowX = "hidden";
+    content.style.whiteSpace = "normal";
+    content.style.fontFamily = "";
+}
 
+function displayNode(nodeId) {
+    let index = nodeIndex.get(nodeId);
+    if (index === undefined) {
+        return;
+    }
+    let annotation = nodeAnnotations[index];
+    let isCode = index >= textCount;
+    // The contents come as HTML, with the code highlighted and the references
+    // of the text linked
+    if (annotation.html === undefined) {
+        loadContent(annotation)
+            .then(() => displayNode(nodeId))
+            .catch(() => showLoadError(annotation));
+        return;
     }
+    viewer.style.display = "flex";
+    viewer.querySelector("h4").textContent = annotation.id;
+    viewer.querySelector("h1").textContent = annotation.title;
+    viewer.querySelector(".file")?.remove();
+    let content = viewer.querySelector(".content");
+    content.innerHTML = annotation.html;
     if(isCode) {
         content.style.color = "white";
         content.style.backgroundColor = "rgb(38, 38, 38)";
         content.style.overflowX = "scroll";
-        content.style.whiteSpace = "nowrap";
+        content.style.whiteSpace = "pre";
+        content.style.fontFamily = "monospace";
         let file = document.createElement("p");
         file.classList.add("file");
         file.textContent = annotation.file + ":" + annotation.line;
@@ -216,18 +342,124 @@ function displayNode(nodeId) {
         content.style.backgroundColor = "white";
         content.style.overflowX = "hidden";
         content.style.whiteSpace = "normal";
+        content.style.fontFamily = "";
+    }
+}
+
+// Large graphs are shown in groups when zoomed out: every group computed by
+// lect is collapsed into a single node, and zooming in expands the groups in
+// view. Only the public clustering API of vis is used, so the viewer doesn't
+// depend on the internals of the bundled version; the group of every node is
+// looked up once, so testing a node for membership is a single Map lookup
+let groups = annotationsJSON.groups;
+let detailed = largeGraph && groups !== undefined &&
+    annotationsJSON.layout !== undefined;
+let detailScale = 0.35;
+let groupCluster = "cluster:group:";
+let groupBoxes = [];
+let nodeGroup = new Map();
+let collapsedGroups = new Set();
+
+if (detailed) {
+    for (let group = 0; group < groups.labels.length; group++) {
+        let box = { left: Infinity, right: -Infinity,
+            top: Infinity, bottom: -Infinity };
+        for (let i = groups.offsets[group]; i < groups.offsets[group + 1]; i++) {
+            let node = groups.members[i];
+            nodeGroup.set(nodeIds[node], group);
+            box.left = Math.min(box.left, annotationsJSON.layout.x[node]);
+            box.right = Math.max(box.right, annotationsJSON.layout.x[node]);
+            box.top = Math.min(box.top, annotationsJSON.layout.y[node]);
+            box.bottom = Math.max(box.bottom, annotationsJSON.layout.y[node]);
+        }
+        groupBoxes.push(box);
+    }
+}
+
+function collapseGroup(group) {
+    let size = groups.offsets[group + 1] - groups.offsets[group];
+    network.cluster({
+        joinCondition: function(nodeOptions) {
+            return nodeGroup.get(nodeOptions.id) === group;
+        },
+        clusterNodeProperties: {
+            id: groupCluster + group,
+            label: groups.labels[group] + "\n" + size + " annotations",
+            borderWidth: 3
+        }
+    });
+    collapsedGroups.add(group);
+}
+
+function expandGroup(group) {
+    network.openCluster(groupCluster + group);
+    collapsedGroups.delete(group);
+}
+
+function expandAllGroups() {
+    for (let group of [...collapsedGroups]) {
+        expandGroup(group);
     }
 }
 
+// Collapses every group when zoomed out, and expands the groups in view when
+// zoomed in. Only the groups are visited, not their nodes
+function updateDetail() {
+    if (!detailed || clustered) {
+        return;
+    }
+    let scale = network.getScale();
+    if (scale < detailScale) {
+        for (let group = 0; group < groupBoxes.length; group++) {
+            if (!collapsedGroups.has(group)) {
+                collapseGroup(group);
+            }
+        }
+    } else {
+        let center = network.getViewPosition();
+        let width = container.clientWidth / scale / 2;
+        let height = container.clientHeight / scale / 2;
+        for (let group of [...collapsedGroups]) {
+            let box = groupBoxes[group];
+            if (box.right >= center.x - width && box.left <= center.x + width &&
+                box.bottom >= center.y - height &&
+                box.top <= center.y + height) {
+                expandGroup(group);
+            }
+        }
+    }
+}
+
+if (detailed) {
+    for (let group = 0; group < groupBoxes.length; group++) {
+        collapseGroup(group);
+    }
+    network.on("zoom", updateDetail);
+    network.on("dragEnd", updateDetail);
+    network.on("doubleClick", (event) => {
+        let id = String(event.nodes[0] ?? "");
+        if (id.startsWith(groupCluster)) {
+            expandGroup(Number(id.slice(groupCluster.length)));
+        }
+    });
+}
+
+// The unconnected nodes are joined into a single cluster with a known ID, so
+// revealing them opens it directly instead of looking for it among the nodes
+let unconnectedCluster = "cluster:unconnected";
+
 function clusterUnconnectedTo(nodeId) {
+    if (detailed) {
+        expandAllGroups();
+    }
     clustered = true;
+    let connected = connectedTo(nodeId);
     network.clustering.cluster({
         joinCondition: function(nodeOptions) {
-            let annotation = annotationsJSON.text_annotations.find((el) => el.id === nodeOptions.id);
-            if (annotation === undefined) {
-                annotation = annotationsJSON.code_annotations.find((el) => el.id === nodeOptions.id);
-            }
-            return annotation["connected_to"].indexOf(nodeId) == -1;
+            return !connected.has(nodeOptions.id);
+        },
+        clusterNodeProperties: {
+            id: unconnectedCluster
         }
     });
     updateControl();
@@ -235,15 +467,142 @@ function clusterUnconnectedTo(nodeId) {
 
 function uncluster() {
     clustered = false;
-    for(let el of network.body.nodeIndices) {
-        if(network.isCluster(el)) {
-            network.openCluster(el);
-        }
+    // Nothing is clustered when every node is connected
+    if(network.body.nodes[unconnectedCluster] !== undefined) {
+        network.openCluster(unconnectedCluster);
     }
+    updateDetail();
     updateControl();
 
 }
 
+// The search index is in search.js, loaded the first time the search box is
+// used. Its terms are sorted, and the postings of a term are the numbers of
+// the nodes it appears in, delta and varint encoded
+let searchInput = document.querySelector("#search input");
+let searchResults = document.querySelector("#search .results");
+let searchPostings = null;
+let searchLoading = null;
+
+function loadSearchIndex() {
+    if (searchLoading === null) {
+        searchLoading = new Promise((resolve, reject) => {
+            let script = document.createElement("script");
+            script.src = "search.js";
+            script.onload = () => {
+                searchPostings = Uint8Array.from(atob(searchIndex.postings),
+                    (char) => char.charCodeAt(0));
+                resolve();
+            };
+            script.onerror = () => {
+                searchLoading = null;
+                reject();
+            };
+            document.body.appendChild(script);
+        });
+    }
+    return searchLoading;
+}
+
+// Splits text into terms the same way the index was built
+function searchTerms(text) {
+    text = text.replace(/[A-Z]/g, (char) => char.toLowerCase());
+    return text.match(/[a-z0-9\u0080-\u{10ffff}]+/gu) ?? [];
+}
+
+function postings(term, found) {
+    let pos = searchIndex.offsets[term];
+    let end = searchIndex.offsets[term + 1];
+    let node = 0;
+    while (pos < end) {
+        let delta = 0;
+        let shift = 0;
+        let byte;
+        do {
+            byte = searchPostings[pos++];
+            delta += (byte & 0x7f) * 2 ** shift;
+            shift += 7;
+        } while (byte & 0x80);
+        node += delta;
+        found.add(node);
+    }
+}
+
+// The terms are sorted by their UTF-8 bytes, which is the order of their code
+// points. Strings compare by UTF-16 code units, which only differs where a
+// surrogate meets a code unit from U+E000 to U+FFFF, so both are moved to the
+// places of the code points they stand for
+function codePointRank(unit) {
+    if (unit >= 0xe000) {
+        return unit - 0x800;
+    }
+    return unit >= 0xd800 ? unit + 0x2000 : unit;
+}
+
+function termLess(a, b) {
+    let length = Math.min(a.length, b.length);
+    for (let i = 0; i < length; i++) {
+        let x = a.charCodeAt(i);
+        let y = b.charCodeAt(i);
+        if (x !== y) {
+            return codePointRank(x) < codePointRank(y);
+        }
+    }
+    return a.length < b.length;
+}
+
+// Nodes that contain a term starting with every word of the query
+function search(query) {
+    let result = null;
+    for (let word of searchTerms(query)) {
+        let terms = searchIndex.terms;
+        let low = 0;
+        let high = terms.length;
+        while (low < high) {
+            let middle = (low + high) >> 1;
+            if (termLess(terms[middle], word)) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        let found = new Set();
+        for (let term = low;
+            term < terms.length && terms[term].startsWith(word); term++) {
+            postings(term, found);
+        }
+        result = result === null ?
+            found : new Set([...result].filter((node) => found.has(node)));
+        if (result.size === 0) {
+            break;
+        }
+    }
+    return result === null ? [] : [...result].sort((a, b) => a - b);
+}
+
+function showSearchResults() {
+    searchResults.innerHTML = "";
+    for (let node of search(searchInput.value).slice(0, 50)) {
+        let annotation = nodeAnnotations[node];
+        let result = document.createElement("p");
+        result.textContent = annotation.id + " " + annotation.title;
+        result.onclick = () => {
+            let visible = network.findNode(annotation.id)[0];
+            if (visible !== undefined) {
+                network.selectNodes([visible]);
+                network.focus(visible, { animation: true });
+            }
+            selectNode(annotation.id);
+            displayNode(annotation.id);
+        };
+        searchResults.appendChild(result);
+    }
+}
+
+searchInput.oninput = () => {
+    loadSearchIndex().then(showSearchResults);
+};
+
 network.on("click", onNodeClick);
 
 document.querySelector(".close").onclick = () => {
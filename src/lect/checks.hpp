@@ -6,17 +6,24 @@
 
 #pragma once
 
+#include "diagnostics.hpp"
+#include "graph.hpp"
+#include "scan.hpp"
 #include "structures.hpp"
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <future>
 #include <iostream>
 #include <iterator>
 #include <memory>
 #include <optional>
-#include <set>
-#include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 namespace lect {
 
 /**
@@ -29,16 +36,54 @@ namespace lect {
 struct Checker {
 
     /**
-     * @brief Check text and code annotations for any errors. If there aren't
-     * any, pass them to the next checker
+     * @brief Check text and code annotations for any errors using every
+     * checker in the chain, and add all found problems to the diagnostics.
+     * Checkers are grouped into waves by their dependencies, and a checker is
+     * skipped if a checker it depends on found a problem. Inside a wave, the
+     * annotations are split into chunks that are walked concurrently, with
+     * every annotation passed to all checkers of the wave, while the checks
+     * of the graph as a whole run alongside them. Without any dependencies,
+     * all checkers run in a single wave
      *
      * @param annotations Annotations to check
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
+     * @param scope Flags of the nodes that need to be checked, or nullptr to
+     * check all of them. Checks of single annotations skip the other nodes,
+     * and checks of the whole graph may limit themselves to problems that
+     * involve the flagged nodes
      * @throw lect::Exception
      */
-    void check(const Annotations &annotations) noexcept(false) {
-        _check(annotations);
-        if (m_next.has_value()) {
-            m_next->get()->check(annotations);
+    void check(const Annotations &annotations, const AnnotationGraph &graph,
+               Diagnostics &diagnostics,
+               const std::vector<bool> *scope = nullptr) noexcept(false) {
+        std::vector<Checker *> chain;
+        for (Checker *checker = this; checker != nullptr;
+             checker = checker->m_next.has_value() ? checker->m_next->get()
+                                                   : nullptr) {
+            chain.push_back(checker);
+        }
+
+        std::vector<bool> failed(chain.size(), false);
+        for (const auto &wave : _waves(chain)) {
+            std::vector<Checker *> runnable;
+            for (std::size_t i : wave) {
+                for (const auto &dependency : chain[i]->dependencies()) {
+                    for (std::size_t j = 0; j < chain.size(); j++) {
+                        if (failed[j] && chain[j]->name() == dependency) {
+                            failed[i] = true;
+                        }
+                    }
+                }
+                if (!failed[i]) {
+                    chain[i]->_reported = 0;
+                    runnable.push_back(chain[i]);
+                }
+            }
+            _run(runnable, annotations, graph, diagnostics, scope);
+            for (std::size_t i : wave) {
+                failed[i] = failed[i] || chain[i]->_reported > 0;
+            }
         }
     };
 
@@ -60,21 +105,225 @@ struct Checker {
         m_next->get()->add(std::move(checker));
     }
 
+    /**
+     * @brief Name of the checker, used as the kind of the problems it reports
+     * and by other checkers to depend on it
+     *
+     * @return Name
+     */
+    virtual std::string name() const { return ""; }
+
+    /**
+     * @brief Names of the checkers that have to run before this one, and
+     * find no problems for this one to run at all. Dependencies that aren't
+     * in the chain are ignored
+     *
+     * @return Names of the dependencies
+     */
+    virtual std::vector<std::string> dependencies() const { return {}; }
+
+    /**
+     * @brief A description of the checker and its options. Results of
+     * previous checks can only be reused if it hasn't changed
+     *
+     * @return Configuration string
+     */
+    virtual std::string configuration() const { return name(); }
+
+    /**
+     * @brief Configurations of all checkers in the chain
+     *
+     * @return Configuration string of the chain
+     */
+    std::string chain_configuration() const {
+        std::string m = configuration();
+        if (m_next.has_value()) {
+            m += "," + m_next->get()->chain_configuration();
+        }
+        return m;
+    }
+
+  protected:
+    /**
+     * @brief Adds a problem found by this checker to the diagnostics, with the
+     * checker's name as its kind
+     *
+     * @param diagnostics Collector of the found problems
+     * @param message Description of the problem
+     * @param file File in which the problem is
+     * @param line Line at which the problem is
+     * @param id ID of the annotation with the problem
+     * @param related IDs of other annotations involved in the problem
+     */
+    void _report(Diagnostics &diagnostics, const std::string &message,
+                 const std::string &file = "", int line = 0,
+                 const std::string &id = "",
+                 std::vector<std::string> related = {}) const {
+        _reported++;
+        diagnostics.add(Diagnostic(name().empty() ? "check" : name(), message,
+                                   file, line, id, std::move(related)));
+    }
+
   private:
     std::optional<std::unique_ptr<Checker>> m_next = std::nullopt;
+    mutable std::atomic<std::size_t> _reported{0};
+
+    /**
+     * @brief Groups the checkers of the chain into waves, so that every
+     * checker runs in a later wave than all of its dependencies
+     *
+     * @param chain Checkers in the order of the chain
+     * @return Waves of checkers, each as indices into the chain
+     * @throw lect::Exception
+     */
+    static std::vector<std::vector<std::size_t>>
+    _waves(const std::vector<Checker *> &chain) noexcept(false) {
+        std::unordered_map<std::string, std::size_t> by_name;
+        for (std::size_t i = 0; i < chain.size(); i++) {
+            if (!chain[i]->name().empty()) {
+                by_name.insert({chain[i]->name(), i});
+            }
+        }
+
+        std::vector<std::size_t> level(chain.size(), 0);
+        bool changed = true;
+        for (std::size_t pass = 0; changed; pass++) {
+            if (pass > chain.size()) {
+                throw Exception("The checkers have cyclic dependencies");
+            }
+            changed = false;
+            for (std::size_t i = 0; i < chain.size(); i++) {
+                for (const auto &dependency : chain[i]->dependencies()) {
+                    auto found = by_name.find(dependency);
+                    if (found != by_name.end() &&
+                        level[i] <= level[found->second]) {
+                        level[i] = level[found->second] + 1;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        std::vector<std::vector<std::size_t>> waves;
+        for (std::size_t i = 0; i < chain.size(); i++) {
+            if (waves.size() <= level[i]) {
+                waves.resize(level[i] + 1);
+            }
+            waves[level[i]].push_back(i);
+        }
+        return waves;
+    }
 
     /**
-     * @brief A virtual function that can be overridden by subclasses to provide
-     * specific checks
+     * @brief Runs checkers concurrently. Exceptions thrown by the checkers
+     * are turned into diagnostics as well
      *
+     * @param chain Checkers to run
      * @param annotations Annotations to check
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
+     * @param scope Flags of the nodes that need to be checked, or nullptr
      */
-    virtual void _check(const Annotations &annotations) noexcept(false) = 0;
+    static void _run(const std::vector<Checker *> &chain,
+                     const Annotations &annotations,
+                     const AnnotationGraph &graph, Diagnostics &diagnostics,
+                     const std::vector<bool> *scope) {
+        if (chain.empty()) {
+            return;
+        }
+        const uint32_t min_chunk = 1024;
+        uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+        uint32_t chunks = std::min(
+            threads, std::max(1u, (graph.size() + min_chunk - 1) / min_chunk));
+        uint32_t chunk_size = (graph.size() + chunks - 1) / chunks;
+
+        std::vector<std::future<void>> futures;
+        for (uint32_t begin = 0; begin < graph.size(); begin += chunk_size) {
+            uint32_t end = std::min(graph.size(), begin + chunk_size);
+            futures.push_back(std::async(std::launch::async, [&, begin, end] {
+                for (uint32_t node = begin; node < end; node++) {
+                    if (scope != nullptr && !(*scope)[node]) {
+                        continue;
+                    }
+                    for (Checker *checker : chain) {
+                        try {
+                            if (graph.is_text(node)) {
+                                checker->_check_text(
+                                    annotations.text_annotations[node], node,
+                                    graph, diagnostics);
+                            } else {
+                                checker->_check_code(
+                                    annotations.code_annotations
+                                        [node - graph.text_count],
+                                    node, graph, diagnostics);
+                            }
+                        } catch (const Exception &e) {
+                            checker->_report(diagnostics, e.what(), "", 0,
+                                             graph.ids[node]);
+                        }
+                    }
+                }
+            }));
+        }
+        for (Checker *checker : chain) {
+            futures.push_back(std::async(std::launch::async, [&, checker] {
+                try {
+                    checker->_check(annotations, graph, diagnostics, scope);
+                } catch (const Exception &e) {
+                    checker->_report(diagnostics, e.what());
+                }
+            }));
+        }
+
+        for (auto &future : futures) {
+            future.get();
+        }
+    }
+
+    /**
+     * @brief A virtual function that can be overridden by subclasses to check
+     * a single text annotation. Can be called from several threads at once
+     *
+     * @param annotation Annotation to check
+     * @param node Node of the annotation in the graph
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
+     */
+    virtual void _check_text(const TextAnnotation &annotation, uint32_t node,
+                             const AnnotationGraph &graph,
+                             Diagnostics &diagnostics) noexcept(false) {}
+
+    /**
+     * @brief A virtual function that can be overridden by subclasses to check
+     * a single code annotation. Can be called from several threads at once
+     *
+     * @param annotation Annotation to check
+     * @param node Node of the annotation in the graph
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
+     */
+    virtual void _check_code(const CodeAnnotation &annotation, uint32_t node,
+                             const AnnotationGraph &graph,
+                             Diagnostics &diagnostics) noexcept(false) {}
+
+    /**
+     * @brief A virtual function that can be overridden by subclasses to
+     * provide checks that need the whole graph at once. Runs alongside the
+     * checks of single annotations
+     *
+     * @param annotations Annotations to check
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
+     * @param scope Flags of the nodes that need to be checked, or nullptr
+     */
+    virtual void _check(const Annotations &annotations,
+                        const AnnotationGraph &graph, Diagnostics &diagnostics,
+                        const std::vector<bool> *scope) noexcept(false) {}
 };
 /**
  * @class CycleChecker
  * @brief A Checker that checks whether there are any cycles of annotation
- * references. If there is, throws an exception.
+ * references, and reports every one of them.
  *
  */
 struct CycleChecker : public Checker {
@@ -83,102 +332,130 @@ struct CycleChecker : public Checker {
      */
     virtual ~CycleChecker() override{};
 
+    virtual std::string name() const override { return "cycle"; }
+
   private:
     /**
      * @brief Function that checks whether there are any cycles of annotation
-     * references
+     * references. Every strongly connected component with more than one node,
+     * or with a node that references itself, contains a cycle. With a scope,
+     * only the components reachable from the nodes in it are looked at, and
+     * only the ones that contain such a node are reported
      *
      * @param annotations Annotations to check
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
+     * @param scope Flags of the nodes that need to be checked, or nullptr
      */
-    virtual void
-    _check(const Annotations &annotations) noexcept(false) override {
-        std::unordered_map<std::string, int> text_referenced;
-        std::vector<std::string> all_reference_ids;
-        for (const auto &text_annotation : annotations.text_annotations) {
-            text_referenced.insert({text_annotation.id, 0});
-            all_reference_ids.push_back(text_annotation.id);
-        }
-        for (const auto &code_annotation : annotations.code_annotations) {
-            text_referenced.insert({code_annotation.id, 0});
-            all_reference_ids.push_back(code_annotation.id);
-        }
-
-        for (const auto &text_annotation : annotations.text_annotations) {
-            for (const auto &ref : text_annotation.references) {
-                text_referenced.at(ref)++;
+    virtual void _check(const Annotations &annotations,
+                        const AnnotationGraph &graph,
+                        Diagnostics &diagnostics,
+                        const std::vector<bool> *scope) noexcept(false)
+        override {
+        std::vector<uint32_t> starts;
+        for (uint32_t node = 0; node < graph.size(); node++) {
+            if (scope == nullptr || (*scope)[node]) {
+                starts.push_back(node);
             }
         }
 
-        std::vector<std::string> roots;
-        for (const auto &[id, count] : text_referenced) {
-            if (count == 0) {
-                roots.push_back(id);
+        bool cyclic = false;
+        for (const auto &component : graph.components(starts)) {
+            if (scope != nullptr &&
+                std::none_of(component.begin(), component.end(),
+                             [scope](uint32_t n) { return (*scope)[n]; })) {
+                continue;
             }
-        }
-        if (roots.size() == 0) {
-            throw Exception("There are no root annotations!");
-        }
-
-        std::unordered_map<std::string, TextAnnotation> text_annotation_map;
-
-        for (const auto &text_annotation : annotations.text_annotations) {
-            text_annotation_map.insert({text_annotation.id, text_annotation});
+            uint32_t first =
+                *std::min_element(component.begin(), component.end());
+            bool self_reference =
+                std::find(graph.children(first).begin(),
+                          graph.children(first).end(),
+                          first) != graph.children(first).end();
+            if (component.size() == 1 && !self_reference) {
+                continue;
+            }
+            cyclic = true;
+            auto cycle = _find_cycle(first, component, graph);
+            std::vector<std::string> related;
+            for (uint32_t node : cycle) {
+                related.push_back(graph.ids[node]);
+            }
+            const std::string &file =
+                annotations.text_annotations[cycle.front()].file;
+            _report(diagnostics,
+                    "There is a cycle of referenced text annotations: " +
+                        _cycle_to_string(cycle, graph),
+                    file, 0, graph.ids[cycle.front()], std::move(related));
         }
 
-        std::set<std::string> total_prev;
-        for (const auto &root : roots) {
-            _iter(root, text_annotation_map, {}, total_prev);
+        // A graph without roots always has a cycle unless it's empty, so with
+        // a scope only the empty graph needs this message
+        if (!cyclic && graph.roots.size() == 0 &&
+            (scope == nullptr || graph.size() == 0)) {
+            _report(diagnostics, "There are no root annotations!");
         }
+    }
 
-        if (total_prev.size() == annotations.text_annotations.size() +
-                                     annotations.code_annotations.size()) {
-            return;
-        }
-        std::vector<std::string> potentially_completely_cyclical;
-        std::set_difference(
-            all_reference_ids.begin(), all_reference_ids.end(),
-            total_prev.begin(), total_prev.end(),
-            std::inserter(potentially_completely_cyclical,
-                          potentially_completely_cyclical.begin()));
-
-        for (const auto &annotation : potentially_completely_cyclical) {
-            _iter(annotation, text_annotation_map, {}, total_prev);
+    /**
+     * @brief Finds the shortest cycle that goes through a node of a strongly
+     * connected component, using breadth-first search inside the component
+     *
+     * @param start Node at which the cycle starts and ends
+     * @param component Nodes of the component
+     * @param graph Reference graph of the annotations
+     * @return Nodes of the cycle, starting with start
+     */
+    static std::vector<uint32_t>
+    _find_cycle(uint32_t start, const std::vector<uint32_t> &component,
+                const AnnotationGraph &graph) {
+        std::unordered_map<uint32_t, uint32_t> previous;
+        for (uint32_t member : component) {
+            previous.insert({member, UINT32_MAX});
         }
-    }
 
-    void
-    _iter(std::string current,
-          std::unordered_map<std::string, TextAnnotation> &text_annotation_map,
-          std::vector<std::string> prev,
-          std::set<std::string> &total_prev) noexcept(false) {
-        auto found = std::find(prev.begin(), prev.end(), current);
-        if (found != prev.end()) {
-            std::string m = "There is a cycle of referenced text annotations: ";
-            for (const auto &a : prev) {
-                m += a + " > ";
+        std::vector<uint32_t> queue{start};
+        for (std::size_t i = 0; i < queue.size(); i++) {
+            uint32_t node = queue[i];
+            for (uint32_t child : graph.children(node)) {
+                auto found = previous.find(child);
+                if (found == previous.end() || found->second != UINT32_MAX) {
+                    continue;
+                }
+                found->second = node;
+                if (child == start) {
+                    queue.clear();
+                    break;
+                }
+                queue.push_back(child);
             }
-            m += current;
-            throw Exception(m);
         }
 
-        TextAnnotation a;
-        try {
-            a = text_annotation_map.at(current);
-        } catch (std::out_of_range e) {
-            return;
+        std::vector<uint32_t> cycle;
+        uint32_t node = previous.at(start);
+        while (node != start) {
+            cycle.push_back(node);
+            node = previous.at(node);
         }
-        std::vector<std::string> new_prev(prev);
-        new_prev.push_back(current);
-        total_prev.insert(current);
-        for (const auto &ref : a.references) {
-            _iter(ref, text_annotation_map, new_prev, total_prev);
+        cycle.push_back(start);
+        std::reverse(cycle.begin(), cycle.end());
+        return cycle;
+    }
+
+    static std::string _cycle_to_string(const std::vector<uint32_t> &cycle,
+                                        const AnnotationGraph &graph) {
+        std::string m;
+        for (uint32_t node : cycle) {
+            m += graph.ids[node] + " > ";
         }
+        return m + graph.ids[cycle.front()];
     }
 };
 
 /**
  * @class NonexistentChecker
- * @brief Check for any annotations that reference nonexistent annotations
+ * @brief Check for any annotations that reference nonexistent annotations.
+ * Reports every such reference of an annotation at once
  *
  */
 struct NonexistentChecker : public Checker {
@@ -187,35 +464,34 @@ struct NonexistentChecker : public Checker {
      */
     virtual ~NonexistentChecker() override{};
 
+    virtual std::string name() const override { return "nonexistent"; }
+
   private:
     /**
-     * @brief A function that checks for any annotations that reference
+     * @brief A function that checks whether a text annotation references
      * nonexistent annotations
      *
-     * @param annotations Annotations to check
-     * @throw lect::Exception
+     * @param annotation Annotation to check
+     * @param node Node of the annotation in the graph
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
      */
     virtual void
-    _check(const Annotations &annotations) noexcept(false) override {
-        std::vector<std::string> ids;
-
-        for (const auto &an : annotations.text_annotations) {
-            ids.push_back(an.id);
-        }
-
-        for (const auto &an : annotations.code_annotations) {
-            ids.push_back(an.id);
-        }
-
-        for (const auto &an : annotations.text_annotations) {
-            for (const auto &ref : an.references) {
-                auto it = std::find(ids.begin(), ids.end(), ref);
-                if (it == ids.end()) {
-                    throw Exception("Annotation `" + ref +
-                                    "` in text annotation `" + an.id +
-                                    "` doesn't exist");
-                }
+    _check_text(const TextAnnotation &annotation, uint32_t node,
+                const AnnotationGraph &graph,
+                Diagnostics &diagnostics) noexcept(false) override {
+        for (std::size_t i = 0; i < annotation.references.size(); i++) {
+            const std::string &ref = annotation.references[i];
+            if (graph.find(ref).has_value()) {
+                continue;
             }
+            int line = i < annotation.reference_lines.size()
+                           ? annotation.reference_lines[i]
+                           : 0;
+            _report(diagnostics,
+                    "Annotation `" + ref + "` in text annotation `" +
+                        annotation.id + "` doesn't exist",
+                    annotation.file, line, annotation.id);
         }
     }
 };
@@ -231,31 +507,49 @@ struct IdAllowedSymbolsChecker : public Checker {
      */
     virtual ~IdAllowedSymbolsChecker() override{};
 
+    virtual std::string name() const override { return "id-symbols"; }
+
   private:
     /**
-     * @brief A function that checks whether all annotation IDs contain only
-     * allowed characters
+     * @brief A function that checks whether a text annotation's ID contains
+     * only allowed characters
      *
-     * @param annotations Annotations to check
+     * @param annotation Annotation to check
+     * @param node Node of the annotation in the graph
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
      */
     virtual void
-    _check(const Annotations &annotations) noexcept(false) override {
-        for (const auto &an : annotations.text_annotations) {
-            uint64_t p = an.id.find_first_not_of(
-                "abcdefghijklmnopqrstuvwxyz-ABCDEFGHIJKLMNOPQRSTUVWXYZ");
-            if (p != std::string::npos) {
-                throw Exception(an.id + " isn't a valid id. Only latin letters "
-                                        "and hyphens are allowed");
-            }
-        }
+    _check_text(const TextAnnotation &annotation, uint32_t node,
+                const AnnotationGraph &graph,
+                Diagnostics &diagnostics) noexcept(false) override {
+        _check_id(annotation.id, annotation.file, 0, diagnostics);
+    }
 
-        for (const auto &an : annotations.code_annotations) {
-            uint64_t p = an.id.find_first_not_of(
-                "abcdefghijklmnopqrstuvwxyz-ABCDEFGHIJKLMNOPQRSTUVWXYZ");
-            if (p != std::string::npos) {
-                throw Exception(an.id + " isn't a valid id. Only latin letters "
-                                        "and hyphens are allowed");
-            }
+    /**
+     * @brief A function that checks whether a code annotation's ID contains
+     * only allowed characters
+     *
+     * @param annotation Annotation to check
+     * @param node Node of the annotation in the graph
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
+     */
+    virtual void
+    _check_code(const CodeAnnotation &annotation, uint32_t node,
+                const AnnotationGraph &graph,
+                Diagnostics &diagnostics) noexcept(false) override {
+        _check_id(annotation.id, annotation.file, annotation.line + 1,
+                  diagnostics);
+    }
+
+    void _check_id(const std::string &id, const std::string &file, int line,
+                   Diagnostics &diagnostics) const {
+        if (!is_valid_id(id)) {
+            _report(diagnostics,
+                    id + " isn't a valid id. Only latin letters and hyphens "
+                         "are allowed",
+                    file, line, id);
         }
     }
 };
@@ -271,29 +565,51 @@ struct DuplicateChecker : public Checker {
      */
     virtual ~DuplicateChecker() override{};
 
+    virtual std::string name() const override { return "duplicate"; }
+
+  private:
     /**
-     * @brief A function that checks whether all annotations have unique IDs
+     * @brief A function that checks whether a text annotation's ID is unique
      *
-     * @param annotations Annotations to check
+     * @param annotation Annotation to check
+     * @param node Node of the annotation in the graph
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
      */
     virtual void
-    _check(const Annotations &annotations) noexcept(false) override {
-        std::set<std::string> id_set;
+    _check_text(const TextAnnotation &annotation, uint32_t node,
+                const AnnotationGraph &graph,
+                Diagnostics &diagnostics) noexcept(false) override {
+        _check_id(annotation.id, node, graph, annotation.file, 0, diagnostics);
+    }
 
-        for (const auto &annotation : annotations.text_annotations) {
-            if (id_set.find(annotation.id) != id_set.end()) {
-                throw Exception("There are at least 2 annotations with ID " +
-                                annotation.id);
-            }
-            id_set.insert(annotation.id);
-        }
+    /**
+     * @brief A function that checks whether a code annotation's ID is unique
+     *
+     * @param annotation Annotation to check
+     * @param node Node of the annotation in the graph
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
+     */
+    virtual void
+    _check_code(const CodeAnnotation &annotation, uint32_t node,
+                const AnnotationGraph &graph,
+                Diagnostics &diagnostics) noexcept(false) override {
+        _check_id(annotation.id, node, graph, annotation.file,
+                  annotation.line + 1, diagnostics);
+    }
 
-        for (const auto &annotation : annotations.code_annotations) {
-            if (id_set.find(annotation.id) != id_set.end()) {
-                throw Exception("There are at least 2 annotations with ID " +
-                                annotation.id);
-            }
-            id_set.insert(annotation.id);
+    /**
+     * @brief The graph maps every ID to the first node that has it, so any
+     * other node with the same ID is a duplicate
+     */
+    void _check_id(const std::string &id, uint32_t node,
+                   const AnnotationGraph &graph, const std::string &file,
+                   int line, Diagnostics &diagnostics) const {
+        if (graph.index.at(id) != node) {
+            _report(diagnostics,
+                    "There are at least 2 annotations with ID " + id, file,
+                    line, id);
         }
     }
 };
@@ -318,21 +634,28 @@ struct CodeAnnotationsSuffixChecker : public Checker {
      */
     CodeAnnotationsSuffixChecker(const std::string suffix) : _suffix(suffix) {}
 
+    virtual std::string name() const override { return "suffix"; }
+
+    virtual std::string configuration() const override {
+        return name() + ":" + _suffix;
+    }
+
   private:
     const std::string _suffix;
 
     virtual void
-    _check(const Annotations &annotations) noexcept(false) override {
-        for (const auto &annotation : annotations.code_annotations) {
-            const std::string id = annotation.id;
-            if (_suffix.size() > id.size() ||
-                _suffix != id.substr(id.size() - _suffix.size())) {
-                throw Exception(
-                    "Code annotation with ID " + color_blue + "'" + id + "'" +
-                    color_reset + " doesn't have suffix " + color_yellow + "'" +
-                    _suffix + "'" + color_reset + ", which was supplied with " +
-                    color_green + "-suf" + color_reset + " argument");
-            }
+    _check_code(const CodeAnnotation &annotation, uint32_t node,
+                const AnnotationGraph &graph,
+                Diagnostics &diagnostics) noexcept(false) override {
+        const std::string &id = annotation.id;
+        if (_suffix.size() > id.size() ||
+            id.compare(id.size() - _suffix.size(), _suffix.size(), _suffix) !=
+                0) {
+            _report(diagnostics,
+                    "Code annotation with ID '" + id +
+                        "' doesn't have suffix '" + _suffix +
+                        "', which was supplied with -suf argument",
+                    annotation.file, annotation.line + 1, id);
         }
     }
 };
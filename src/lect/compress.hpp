@@ -0,0 +1,148 @@
+/**
+ * @file compress.hpp
+ * @brief A function that writes gzip compressed copies of the exported files
+ */
+
+#pragma once
+
+#include "structures.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+namespace lect {
+
+/**
+ * @brief Compresses a chunk of data into a raw deflate stream. The deflate
+ * window is primed with the data that precedes the chunk, so that the
+ * compression is as good as if the whole file was compressed at once. All
+ * chunks but the last end on a byte boundary, which makes their streams
+ * possible to concatenate
+ *
+ * @param data Data to compress
+ * @param size Size of the chunk
+ * @param dictionary Size of the data before the chunk to prime the window with
+ * @param last Whether this is the last chunk of the file
+ * @param level Compression level, from 1 to 9
+ * @return Raw deflate stream
+ * @throw lect::Exception
+ */
+inline std::string _deflate_chunk(const char *data, std::size_t size,
+                                  std::size_t dictionary, bool last,
+                                  int level) noexcept(false) {
+    z_stream stream{};
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw Exception("Couldn't initialize the compression");
+    }
+    if (dictionary > 0) {
+        deflateSetDictionary(
+            &stream, reinterpret_cast<const Bytef *>(data - dictionary),
+            dictionary);
+    }
+
+    std::string out;
+    out.resize(deflateBound(&stream, size) + 16);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = size;
+    stream.next_out = reinterpret_cast<Bytef *>(out.data());
+    stream.avail_out = out.size();
+    int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    out.resize(out.size() - stream.avail_out);
+    deflateEnd(&stream);
+    if (result != (last ? Z_STREAM_END : Z_OK)) {
+        throw Exception("Couldn't compress the data");
+    }
+    return out;
+}
+
+//$gzip-file-src Parallel gzip
+/**
+ * @brief Writes a gzip compressed copy of a file. The file is split into
+ * chunks that are compressed in parallel and joined into a single gzip member,
+ * so the result can be decompressed by any client. Only a window of chunks is
+ * in memory at any time
+ *
+ * @param path Path of the file to compress
+ * @param gz_path Path of the compressed copy
+ * @param level Compression level, from 1 to 9
+ * @throw lect::Exception
+ */
+inline void gzip_file(const std::filesystem::path &path,
+                      const std::filesystem::path &gz_path,
+                      int level) noexcept(false) {
+    const std::size_t chunk = 1 << 20;
+    const std::size_t window = 1 << 15;
+    const std::size_t threads =
+        std::max(1u, std::thread::hardware_concurrency());
+
+    std::ifstream in(path, std::ios::binary);
+    std::ofstream out(gz_path, std::ios::binary);
+    if (!in || !out) {
+        throw Exception("Couldn't compress `" + path.string() + "`");
+    }
+
+    const char header[] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3};
+    out.write(header, sizeof(header));
+
+    uLong crc = crc32(0, nullptr, 0);
+    uint64_t total = 0;
+    std::uintmax_t size = std::filesystem::file_size(path);
+
+    // The buffer starts with the last bytes of the previous window, which
+    // the first chunk uses as its dictionary
+    std::string buffer;
+    std::size_t kept = 0;
+    while (true) {
+        buffer.resize(kept + chunk * threads);
+        in.read(buffer.data() + kept, chunk * threads);
+        std::size_t read = in.gcount();
+        buffer.resize(kept + read);
+        bool last = read < chunk * threads || total + read >= size;
+
+        std::vector<std::future<std::string>> parts;
+        for (std::size_t begin = kept; begin < buffer.size() || parts.empty();
+             begin += chunk) {
+            std::size_t end = std::min(buffer.size(), begin + chunk);
+            std::size_t dictionary = std::min(begin, window);
+            bool final = last && end == buffer.size();
+            const char *data = buffer.data() + begin;
+            parts.push_back(std::async(std::launch::async, [=]() {
+                return _deflate_chunk(data, end - begin, dictionary, final,
+                                      level);
+            }));
+        }
+        for (auto &part : parts) {
+            std::string compressed = part.get();
+            out.write(compressed.data(), compressed.size());
+        }
+
+        crc = crc32(crc, reinterpret_cast<const Bytef *>(buffer.data() + kept),
+                    read);
+        total += read;
+        if (last) {
+            break;
+        }
+        kept = std::min(buffer.size(), window);
+        buffer.erase(0, buffer.size() - kept);
+    }
+
+    char trailer[8];
+    for (int i = 0; i < 4; i++) {
+        trailer[i] = (crc >> (8 * i)) & 0xff;
+        trailer[4 + i] = (total >> (8 * i)) & 0xff;
+    }
+    out.write(trailer, sizeof(trailer));
+    out.close();
+    if (!out) {
+        throw Exception("Couldn't write `" + gz_path.string() + "`");
+    }
+}
+
+} // namespace lect
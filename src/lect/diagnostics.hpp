@@ -0,0 +1,236 @@
+/**
+ * @file diagnostics.hpp
+ * @brief A collector of the problems found while extracting and checking the
+ * annotations, which can be printed or written out as a JSON or SARIF report
+ */
+
+#pragma once
+
+#include "nlohmann/json.hpp"
+#include "structures.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace lect {
+
+/**
+ * @brief Turns a relative file path into a relative URI reference, with `/`
+ * as the separator and every byte but the unreserved characters of RFC 3986
+ * percent-encoded, so that spaces, `#`, `?`, `:` and non-ASCII names survive
+ *
+ * @param file Path of the file
+ * @return URI reference
+ */
+inline std::string uri_reference(const std::string &file) {
+    const char *hex = "0123456789ABCDEF";
+    std::string uri;
+    for (unsigned char c : std::filesystem::path(file).generic_string()) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' ||
+            c == '~' || c == '/') {
+            uri += c;
+        } else {
+            uri += '%';
+            uri += hex[c >> 4];
+            uri += hex[c & 0xf];
+        }
+    }
+    return uri;
+}
+
+/**
+ * @class Diagnostic
+ * @brief A single problem with the annotations
+ *
+ */
+struct Diagnostic {
+    std::string kind;
+    std::string message;
+    std::string file;
+    int line;
+    std::string id;
+    std::vector<std::string> related;
+
+    Diagnostic(std::string kind, std::string message, std::string file = "",
+               int line = 0, std::string id = "",
+               std::vector<std::string> related = {})
+        : kind(kind), message(message), file(file), line(line), id(id),
+          related(related) {}
+
+    bool operator==(const Diagnostic &other) const {
+        return std::tie(kind, message, file, line, id) ==
+               std::tie(other.kind, other.message, other.file, other.line,
+                        other.id);
+    }
+};
+
+//$diagnostics-src Diagnostics class
+/**
+ * @class Diagnostics
+ * @brief A thread-safe collector of diagnostics. Extraction and the checkers
+ * add every problem they find here instead of stopping at the first one
+ *
+ */
+struct Diagnostics {
+    /**
+     * @brief Adds a diagnostic. Safe to call from several threads at once
+     *
+     * @param diagnostic Diagnostic to add
+     */
+    void add(Diagnostic diagnostic) {
+        const std::lock_guard<std::mutex> lock_guard(_mutex);
+        _diagnostics.push_back(std::move(diagnostic));
+    }
+
+    /**
+     * @brief Number of collected diagnostics
+     *
+     * @return Number of diagnostics
+     */
+    std::size_t size() {
+        const std::lock_guard<std::mutex> lock_guard(_mutex);
+        return _diagnostics.size();
+    }
+
+    /**
+     * @brief Checks whether no problems were found
+     *
+     * @return true if there are no diagnostics, false otherwise
+     */
+    bool empty() { return size() == 0; }
+
+    /**
+     * @brief Returns the diagnostics ordered by file, line, kind, ID and
+     * message, so that the order doesn't depend on the order in which threads
+     * found them
+     *
+     * @return Sorted diagnostics
+     */
+    std::vector<Diagnostic> sorted() {
+        std::vector<Diagnostic> diagnostics;
+        {
+            const std::lock_guard<std::mutex> lock_guard(_mutex);
+            diagnostics = _diagnostics;
+        }
+        std::sort(diagnostics.begin(), diagnostics.end(),
+                  [](const Diagnostic &a, const Diagnostic &b) {
+                      return std::tie(a.file, a.line, a.kind, a.id,
+                                      a.message) < std::tie(b.file, b.line,
+                                                            b.kind, b.id,
+                                                            b.message);
+                  });
+        return diagnostics;
+    }
+
+    /**
+     * @brief Formats the diagnostics as colored text for the terminal
+     *
+     * @return Text with one entry per diagnostic
+     */
+    std::string to_text() {
+        std::string text;
+        for (const auto &d : sorted()) {
+            text += color_red + "ERROR: " + color_reset;
+            if (!d.file.empty()) {
+                text += color_yellow + d.file + color_reset;
+                if (d.line > 0) {
+                    text += ":" + color_blue + std::to_string(d.line) +
+                            color_reset;
+                }
+                text += "\n  ";
+            }
+            text += d.message + "\n";
+        }
+        return text;
+    }
+
+    /**
+     * @brief Converts the diagnostics to a JSON document
+     *
+     * @return JSON document with an array of diagnostics
+     */
+    nlohmann::json to_json() {
+        using namespace nlohmann;
+        json list = json::array();
+        for (const auto &d : sorted()) {
+            list.push_back({{"kind", d.kind},
+                            {"message", d.message},
+                            {"file", d.file},
+                            {"line", d.line},
+                            {"id", d.id}});
+        }
+        return {{"diagnostics", list}};
+    }
+
+    /**
+     * @brief Converts the diagnostics to a SARIF 2.1.0 log, with the kind of
+     * each diagnostic used as its rule
+     *
+     * @return SARIF document
+     */
+    nlohmann::json to_sarif() {
+        using namespace nlohmann;
+        std::vector<Diagnostic> diagnostics = sorted();
+
+        std::set<std::string> kinds;
+        json results = json::array();
+        for (const auto &d : diagnostics) {
+            kinds.insert(d.kind);
+            json result = {{"ruleId", d.kind},
+                           {"level", "error"},
+                           {"message", {{"text", d.message}}}};
+            if (!d.file.empty()) {
+                json location = {
+                    {"artifactLocation", {{"uri", uri_reference(d.file)}}}};
+                if (d.line > 0) {
+                    location["region"] = {{"startLine", d.line}};
+                }
+                result["locations"] = {{{"physicalLocation", location}}};
+            }
+            if (!d.id.empty()) {
+                result["properties"] = {{"annotation", d.id}};
+            }
+            results.push_back(result);
+        }
+
+        json rules = json::array();
+        for (const auto &kind : kinds) {
+            rules.push_back({{"id", kind}});
+        }
+
+        return {{"version", "2.1.0"},
+                {"$schema", "https://json.schemastore.org/sarif-2.1.0.json"},
+                {"runs",
+                 {{{"tool", {{"driver", {{"name", "lect"}, {"rules", rules}}}}},
+                   {"results", results}}}}};
+    }
+
+    /**
+     * @brief Writes a report to a file
+     *
+     * @param path Path of the report
+     * @param json Report document
+     * @throw lect::Exception
+     */
+    static void write_report(const std::filesystem::path &path,
+                             const nlohmann::json &json) noexcept(false) {
+        std::ofstream file(path);
+        if (!file) {
+            throw Exception("Couldn't write the report to `" + path.string() +
+                            "`");
+        }
+        file << json.dump(2) << "\n";
+    }
+
+  private:
+    std::mutex _mutex;
+    std::vector<Diagnostic> _diagnostics;
+};
+
+} // namespace lect
@@ -5,27 +5,527 @@
 
 #pragma once
 
+#include "compress.hpp"
+#include "files.hpp"
+#include "highlight.hpp"
+#include "html.hpp"
 #include "index_html.hpp"
-#include "nlohmann/json.hpp"
-#include "nlohmann/json_fwd.hpp"
+#include "index_html_gz.hpp"
+#include "json_writer.hpp"
+#include "msgpack_js.hpp"
+#include "msgpack_js_gz.hpp"
+#include "msgpack_writer.hpp"
+#include "preprocessing.hpp"
 #include "script_js.hpp"
+#include "script_js_gz.hpp"
+#include "search.hpp"
 #include "structures.hpp"
 #include "vis_js.hpp"
+#include "vis_js_gz.hpp"
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
+#include <future>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace lect {
 
+/**
+ * @brief Formats in which the annotations can be exported
+ */
+enum class PayloadFormat {
+    /**
+     * @brief A JavaScript object literal
+     */
+    json,
+    /**
+     * @brief A separate MessagePack file, which the viewer fetches and decodes
+     */
+    msgpack,
+};
+
+/**
+ * @class ExportOptions
+ * @brief Options that change how the documentation is written
+ *
+ */
+struct ExportOptions {
+    /**
+     * @brief Format in which to write the annotations
+     */
+    PayloadFormat format = PayloadFormat::json;
+    /**
+     * @brief Compression level of the gzipped copies of the exported files,
+     * from 1 to 9. No copies are written without it
+     */
+    std::optional<int> gzip_level;
+    /**
+     * @brief Whether to move the contents of the annotations out of
+     * annotations.js into shards that the viewer loads when they are displayed
+     */
+    bool shards = false;
+};
+
+/**
+ * @brief Chooses how many hexadecimal digits of the hash of an ID name its
+ * content shard, so that shards hold around 64 annotations
+ *
+ * @param count Number of annotations
+ * @return Number of digits, from 1 to 4
+ */
+inline int shard_digits(std::size_t count) {
+    int digits = 1;
+    while (digits < 4 && count > (std::size_t(64) << (4 * digits))) {
+        digits++;
+    }
+    return digits;
+}
+
+/**
+ * @brief Name of the content shard of an annotation: the first digits of the
+ * hexadecimal 32-bit FNV-1a hash of its ID. The viewer computes the same hash
+ * to find the shard
+ *
+ * @param id ID of the annotation
+ * @param digits Number of digits of the name
+ * @return Name of the shard
+ */
+inline std::string shard_prefix(const std::string &id, int digits) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : id) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    static const char hex[] = "0123456789abcdef";
+    std::string prefix;
+    for (int i = 0; i < digits; i++) {
+        prefix += hex[(hash >> (28 - 4 * i)) & 0xf];
+    }
+    return prefix;
+}
+
+/**
+ * @brief Serializes a text annotation. Keys are written in sorted order and
+ * references are sorted and deduplicated. The content is written as HTML with
+ * the references already linked, which the viewer inserts as it is
+ *
+ * @tparam Writer JsonWriter or MessagePackWriter
+ * @param writer Writer to serialize into
+ * @param annotation Annotation to serialize
+ * @param content Whether to include the content
+ */
+template <typename Writer>
+void write_annotation(Writer &writer, const TextAnnotation &annotation,
+                      bool content = true) {
+    std::vector<const std::string *> references;
+    references.reserve(annotation.references.size());
+    for (const auto &ref : annotation.references) {
+        references.push_back(&ref);
+    }
+    auto less = [](const std::string *a, const std::string *b) {
+        return *a < *b;
+    };
+    auto equal = [](const std::string *a, const std::string *b) {
+        return *a == *b;
+    };
+    std::sort(references.begin(), references.end(), less);
+    references.erase(
+        std::unique(references.begin(), references.end(), equal),
+        references.end());
+
+    writer.begin_object(3 + content);
+    if (content) {
+        writer.key("html").string(text_html(annotation));
+    }
+    writer.key("id").string(annotation.id);
+    writer.key("references").begin_array(references.size());
+    for (const std::string *ref : references) {
+        writer.string(*ref);
+    }
+    writer.end_array();
+    writer.key("title").string(annotation.title);
+    writer.end_object();
+}
+
+/**
+ * @brief Serializes a code annotation. Keys are written in sorted order. The
+ * content is written as highlighted HTML, which the viewer inserts as it is
+ *
+ * @tparam Writer JsonWriter or MessagePackWriter
+ * @param writer Writer to serialize into
+ * @param annotation Annotation to serialize
+ * @param content Whether to include the content
+ */
+template <typename Writer>
+void write_annotation(Writer &writer, const CodeAnnotation &annotation,
+                      bool content = true) {
+    writer.begin_object(4 + content);
+    writer.key("file").string(annotation.file);
+    if (content) {
+        writer.key("html").string(highlight_html(annotation));
+    }
+    writer.key("id").string(annotation.id);
+    writer.key("line").number(annotation.line);
+    writer.key("title").string(annotation.title);
+    writer.end_object();
+}
+
+/**
+ * @brief Serializes an array of annotations. Large arrays are split into
+ * chunks that are serialized into separate buffers in parallel and then
+ * written in order, so the output is the same as if it was serialized
+ * serially. Only a window of chunks is in memory at any time
+ *
+ * @tparam Writer JsonWriter or MessagePackWriter
+ * @tparam T Annotation type
+ * @param writer Writer to serialize into
+ * @param annotations Annotations to serialize
+ * @param content Whether to include the contents
+ */
+template <typename Writer, typename T>
+void write_annotations(Writer &writer, const std::vector<T> &annotations,
+                       bool content = true) {
+    const std::size_t chunk = 256;
+    const std::size_t threads =
+        std::max(1u, std::thread::hardware_concurrency());
+
+    writer.begin_array(annotations.size());
+    if (annotations.size() <= chunk || threads == 1) {
+        for (const auto &a : annotations) {
+            write_annotation(writer, a, content);
+        }
+        writer.end_array();
+        return;
+    }
+
+    for (std::size_t window = 0; window < annotations.size();
+         window += chunk * threads) {
+        std::size_t window_end =
+            std::min(annotations.size(), window + chunk * threads);
+        std::vector<std::future<std::string>> parts;
+        for (std::size_t begin = window; begin < window_end; begin += chunk) {
+            std::size_t end = std::min(window_end, begin + chunk);
+            parts.push_back(
+                std::async(std::launch::async, [&annotations, begin, end,
+                                                content]() {
+                    Writer part;
+                    part.begin_fragment();
+                    for (std::size_t i = begin; i < end; i++) {
+                        write_annotation(part, annotations[i], content);
+                    }
+                    part.end_fragment();
+                    return std::move(part.buffer());
+                }));
+        }
+        for (auto &part : parts) {
+            writer.raw(part.get());
+        }
+    }
+    writer.end_array();
+}
+
+//$write-payload-src Payload serialization
+/**
+ * @brief Serializes the payload as an object straight into the writer,
+ * without building a document in memory. Keys are written in sorted order, so
+ * the output is the same as the one of nlohmann::json::dump() or
+ * nlohmann::json::to_msgpack()
+ *
+ * @tparam Writer JsonWriter or MessagePackWriter
+ * @param writer Writer to serialize into
+ * @param payload Payload to serialize
+ * @param shards Number of digits of the names of the content shards, if the
+ * contents are written into shards instead of the payload
+ */
+template <typename Writer>
+void write_payload(Writer &writer, const Payload &payload,
+                   std::optional<int> shards = std::nullopt) {
+    bool content = !shards.has_value();
+    writer.begin_object(3 + payload.direction.has_value() +
+                        payload.groups.has_value() +
+                        payload.layout.has_value() +
+                        payload.lineup.has_value() + shards.has_value());
+
+    writer.key("code_annotations");
+    write_annotations(writer, payload.annotations.code_annotations, content);
+
+    if (payload.direction.has_value()) {
+        writer.key("dir").string(*payload.direction);
+    }
+
+    writer.key("graph").begin_object(2);
+    writer.key("offsets").begin_array(payload.graph_offsets.size());
+    for (uint32_t offset : payload.graph_offsets) {
+        writer.number(offset);
+    }
+    writer.end_array();
+    writer.key("targets").begin_array(payload.graph_targets.size());
+    for (uint32_t target : payload.graph_targets) {
+        writer.number(target);
+    }
+    writer.end_array();
+    writer.end_object();
+
+    if (payload.groups.has_value()) {
+        writer.key("groups").begin_object(3);
+        writer.key("labels").begin_array(payload.groups->labels.size());
+        for (const auto &label : payload.groups->labels) {
+            writer.string(label);
+        }
+        writer.end_array();
+        writer.key("members").begin_array(payload.groups->members.size());
+        for (uint32_t member : payload.groups->members) {
+            writer.number(member);
+        }
+        writer.end_array();
+        writer.key("offsets").begin_array(payload.groups->offsets.size());
+        for (uint32_t offset : payload.groups->offsets) {
+            writer.number(offset);
+        }
+        writer.end_array();
+        writer.end_object();
+    }
+
+    if (payload.layout.has_value()) {
+        writer.key("layout").begin_object(2);
+        writer.key("x").begin_array(payload.layout->x.size());
+        for (int32_t x : payload.layout->x) {
+            writer.number(x);
+        }
+        writer.end_array();
+        writer.key("y").begin_array(payload.layout->y.size());
+        for (int32_t y : payload.layout->y) {
+            writer.number(y);
+        }
+        writer.end_array();
+        writer.end_object();
+    }
+
+    if (payload.lineup.has_value()) {
+        writer.key("shake").string(*payload.lineup);
+    }
+
+    if (shards.has_value()) {
+        writer.key("shards").number(*shards);
+    }
+
+    writer.key("text_annotations");
+    write_annotations(writer, payload.annotations.text_annotations, content);
+
+    writer.end_object();
+}
+
+/**
+ * @brief Views a compressed resource as a string
+ *
+ * @tparam N Size of the resource
+ * @param bytes Compressed resource
+ * @return View of the bytes
+ */
+template <std::size_t N>
+std::string_view _bytes(const unsigned char (&bytes)[N]) {
+    return std::string_view(reinterpret_cast<const char *>(bytes), N);
+}
+
+/**
+ * @brief Writes the gzipped copy of a file next to it, unless the copy is up
+ * to date
+ *
+ * @param file Path of the file
+ * @param level Compression level, from 1 to 9
+ * @throw lect::Exception
+ */
+void _gzip_copy(const std::filesystem::path &file, int level) noexcept(false) {
+    std::filesystem::path gz_path = file;
+    gz_path += ".gz";
+    gzip_file(file, temp_path(gz_path), level);
+    replace_if_changed(temp_path(gz_path), gz_path);
+}
+
+/**
+ * @brief Writes the annotations, and their gzipped copies if requested. Every
+ * file is first written to a temporary file, which only replaces the
+ * previous one if the content differs. The MessagePack file of a previous
+ * export is removed when the annotations are written as JSON
+ *
+ * @param path Path of the documentation directory
+ * @param payload Payload that contains the annotations
+ * @param options Options of the export
+ * @param shards Number of digits of the names of the content shards, if the
+ * contents are written into shards
+ * @throw lect::Exception
+ */
+void _export_payload(const std::filesystem::path &path,
+                     const Payload &payload, const ExportOptions &options,
+                     std::optional<int> shards) noexcept(false) {
+    std::vector<std::filesystem::path> files = {path / "annotations.js"};
+    std::ofstream write_file(temp_path(files.back()), std::ios::binary);
+    if (options.format == PayloadFormat::msgpack) {
+        write_file << "const annotationsMessagePack = \"annotations.msgpack\";";
+        write_file.close();
+
+        files.push_back(path / "annotations.msgpack");
+        write_file.open(temp_path(files.back()), std::ios::binary);
+        MessagePackWriter writer(&write_file);
+        write_payload(writer, payload, shards);
+    } else {
+        remove_if_exists(path / "annotations.msgpack");
+        remove_if_exists(path / "annotations.msgpack.gz");
+
+        write_file << "const annotationsJSON = ";
+        JsonWriter writer(&write_file);
+        write_payload(writer, payload, shards);
+    }
+    write_file.close();
+    if (!write_file) {
+        throw Exception("Couldn't write the annotations to `" + path.string() +
+                        "`");
+    }
+
+    for (const auto &file : files) {
+        replace_if_changed(temp_path(file), file);
+        if (options.gzip_level.has_value()) {
+            _gzip_copy(file, *options.gzip_level);
+        }
+    }
+}
+
+//$content-shards-src Content shards
+/**
+ * @brief Writes the contents of the annotations into shards in the content
+ * directory. Every shard is a script that passes the contents of the
+ * annotations whose IDs hash to its name to annotationContent() in the
+ * viewer, so it can be loaded on demand even without a web server. The
+ * contents are the same HTML as in the payload. An ID shared by several
+ * annotations gets the content of the one the viewer displays: the first text
+ * annotation, or else the first code annotation. Shards of previous exports
+ * that no longer exist are removed
+ *
+ * @param path Path of the documentation directory
+ * @param payload Payload that contains the annotations
+ * @param options Options of the export
+ * @param digits Number of digits of the names of the shards
+ * @throw lect::Exception
+ */
+void _export_shards(const std::filesystem::path &path, const Payload &payload,
+                    const ExportOptions &options,
+                    int digits) noexcept(false) {
+    using Entry = std::pair<const TextAnnotation *, const CodeAnnotation *>;
+    std::map<std::string, std::vector<Entry>> shards;
+    std::unordered_set<std::string_view> seen;
+    for (const auto &a : payload.annotations.text_annotations) {
+        if (seen.insert(a.id).second) {
+            shards[shard_prefix(a.id, digits)].push_back({&a, nullptr});
+        }
+    }
+    for (const auto &a : payload.annotations.code_annotations) {
+        if (seen.insert(a.id).second) {
+            shards[shard_prefix(a.id, digits)].push_back({nullptr, &a});
+        }
+    }
+
+    std::filesystem::path directory = path / "content";
+    std::filesystem::create_directories(directory);
+    for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+        std::string name = entry.path().filename().string();
+        bool gz = name.size() > 3 && name.substr(name.size() - 3) == ".gz";
+        std::string prefix = name.substr(0, name.find('.'));
+        if (shards.find(prefix) == shards.end() ||
+            name != prefix + (gz ? ".js.gz" : ".js") ||
+            (gz && !options.gzip_level.has_value())) {
+            std::filesystem::remove(entry.path());
+        }
+    }
+
+    std::vector<const std::pair<const std::string, std::vector<Entry>> *>
+        list;
+    for (const auto &shard : shards) {
+        list.push_back(&shard);
+    }
+    const std::size_t threads =
+        std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::future<void>> writes;
+    for (std::size_t t = 0; t < std::min(threads, list.size()); t++) {
+        writes.push_back(std::async(std::launch::async, [&, t]() {
+            for (std::size_t i = t; i < list.size(); i += threads) {
+                const auto &[prefix, entries] = *list[i];
+                JsonWriter writer;
+                writer.raw("annotationContent(");
+                writer.string(prefix);
+                writer.raw(",");
+                writer.begin_object(entries.size());
+                for (const auto &[text, code] : entries) {
+                    if (text != nullptr) {
+                        writer.key(text->id).string(text_html(*text));
+                    } else {
+                        writer.key(code->id).string(highlight_html(*code));
+                    }
+                }
+                writer.end_object();
+                writer.raw(");");
+
+                std::filesystem::path file = directory / (prefix + ".js");
+                write_if_changed(file, writer.buffer());
+                if (options.gzip_level.has_value()) {
+                    _gzip_copy(file, *options.gzip_level);
+                }
+            }
+        }));
+    }
+    for (auto &write : writes) {
+        write.wait();
+    }
+    for (auto &write : writes) {
+        write.get();
+    }
+}
+
+/**
+ * @brief Writes the search index into search.js, which the viewer loads when
+ * the search box is first used
+ *
+ * @param path Path of the documentation directory
+ * @param payload Payload that contains the annotations
+ * @param options Options of the export
+ * @throw lect::Exception
+ */
+void _export_search(const std::filesystem::path &path, const Payload &payload,
+                    const ExportOptions &options) noexcept(false) {
+    JsonWriter writer;
+    writer.raw("const searchIndex = ");
+    SearchIndex::build(payload.annotations).write(writer);
+    writer.raw(";");
+
+    std::filesystem::path file = path / "search.js";
+    write_if_changed(file, writer.buffer());
+    if (options.gzip_level.has_value()) {
+        _gzip_copy(file, *options.gzip_level);
+    }
+}
+
 /**
  * @brief Generate the documentation at the directory at path using the
- * annotations in the JSON document
+ * annotations in the payload. With a gzip level, every file also gets a
+ * gzipped copy next to it, which web servers can serve directly. The static
+ * files were compressed when lect was built, only the annotations are
+ * compressed here. Without a gzip level, the gzipped copies of a previous
+ * export are removed, or servers would keep sending them instead of the new
+ * files. Without shards, the content shards of a previous export are removed
+ * as well. Files are written in parallel, and files whose content didn't change
+ * since the previous export are left untouched
  *
  * @param path Path at which to create the documentation
- * @param json JSON that contains the annotations
+ * @param payload Payload that contains the annotations
+ * @param options Options of the export
  */
-void export_to_dir(const std::filesystem::path &path,
-                   const nlohmann::json &json) noexcept(false) {
+void export_to_dir(const std::filesystem::path &path, const Payload &payload,
+                   const ExportOptions &options = {}) noexcept(false) {
 
     if (!std::filesystem::exists(path)) {
         try {
@@ -36,21 +536,56 @@ void export_to_dir(const std::filesystem::path &path,
         }
     }
 
-    std::ofstream write_file(path / "annotations.js");
-    write_file << "const annotationsJSON = " + json.dump();
-    write_file.close();
-
-    write_file.open(path / "index.html");
-    write_file << index_html;
-    write_file.close();
+    std::vector<std::pair<std::string, std::string_view>> static_files = {
+        {"index.html", index_html},
+        {"vis-network.min.js", vis_js},
+        {"script.js", script_js},
+        {"msgpack.js", msgpack_js},
+    };
+    if (options.gzip_level.has_value()) {
+        static_files.push_back({"index.html.gz", _bytes(index_html_gz)});
+        static_files.push_back({"vis-network.min.js.gz", _bytes(vis_js_gz)});
+        static_files.push_back({"script.js.gz", _bytes(script_js_gz)});
+        static_files.push_back({"msgpack.js.gz", _bytes(msgpack_js_gz)});
+    } else {
+        for (const char *name :
+             {"index.html", "vis-network.min.js", "script.js", "msgpack.js",
+              "annotations.js", "annotations.msgpack", "search.js"}) {
+            remove_if_exists(path / (std::string(name) + ".gz"));
+        }
+    }
 
-    write_file.open(path / "vis-network.min.js");
-    write_file << vis_js;
-    write_file.close();
+    std::optional<int> shards;
+    if (options.shards) {
+        shards = shard_digits(payload.annotations.text_annotations.size() +
+                              payload.annotations.code_annotations.size());
+    } else {
+        remove_if_exists(path / "content");
+    }
 
-    write_file.open(path / "script.js");
-    write_file << script_js;
-    write_file.close();
+    std::vector<std::future<void>> writes;
+    writes.push_back(std::async(std::launch::async, [&]() {
+        _export_payload(path, payload, options, shards);
+    }));
+    if (shards.has_value()) {
+        writes.push_back(std::async(std::launch::async, [&]() {
+            _export_shards(path, payload, options, *shards);
+        }));
+    }
+    writes.push_back(std::async(std::launch::async, [&]() {
+        _export_search(path, payload, options);
+    }));
+    for (const auto &file : static_files) {
+        writes.push_back(std::async(std::launch::async, [&path, &file]() {
+            write_if_changed(path / file.first, file.second);
+        }));
+    }
+    for (auto &write : writes) {
+        write.wait();
+    }
+    for (auto &write : writes) {
+        write.get();
+    }
 }
 
 } // namespace lect
@@ -6,6 +6,10 @@
 
 #pragma once
 
+#include "diagnostics.hpp"
+#include "highlight.hpp"
+#include "registry.hpp"
+#include "scan.hpp"
 #include "structures.hpp"
 #include "tree_sitter/api.h"
 #include <algorithm>
@@ -15,11 +19,15 @@
 #include <fstream>
 #include <future>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <tree-sitter-cpp.h>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -34,6 +42,15 @@ namespace lect {
  */
 struct AnnotationsBuilder {
 
+    /**
+     * @brief A constructor
+     *
+     * @param diagnostics Collector of the problems found during extraction.
+     * Annotations with problems are skipped, and the extraction goes on
+     */
+    explicit AnnotationsBuilder(Diagnostics &diagnostics)
+        : _diagnostics(diagnostics) {}
+
     /**
      * @brief A function that extracts all code annotations from the
      * file/directory
@@ -51,20 +68,44 @@ struct AnnotationsBuilder {
         std::mutex mutex;
         std::vector<CodeAnnotation> &code_annotations =
             _annotations.code_annotations;
-        auto add = [&code_annotations,
-                    &mutex](std::string id, std::string title,
-                            std::string content, std::string file, int line) {
+        auto add = [&code_annotations, &mutex](
+                       std::string id, std::string title, std::string content,
+                       std::string file, int line,
+                       std::vector<Highlight> highlights) {
             const std::lock_guard<std::mutex> lock_guard(mutex);
-            code_annotations.emplace_back(id, title, content, file, line);
+            code_annotations.emplace_back(id, title, content, file, line,
+                                          std::move(highlights));
         };
 
-        _extract_code_annotations_inner(root, language, add);
+        // The highlights query is compiled once and shared by the files,
+        // every file runs it with its own cursor. Highlighting is cosmetic, so
+        // a broken query only leaves the code unhighlighted
+        std::unique_ptr<TSQuery, void (*)(TSQuery *)> highlights(
+            nullptr, ts_query_delete);
+        if (!language.highlights.empty() && language.language != nullptr) {
+            uint32_t error_offset;
+            TSQueryError query_error;
+            highlights.reset(ts_query_new(
+                language.language, language.highlights.c_str(),
+                language.highlights.size(), &error_offset, &query_error));
+            if (query_error != 0) {
+                std::cout << color_yellow + "WARNING: " + color_reset +
+                                 "Issue with the " + language.name +
+                                 " highlights query at " +
+                                 std::to_string(error_offset) + " of kind " +
+                                 std::to_string(query_error) +
+                                 ", the code isn't highlighted"
+                          << "\n";
+            }
+        }
+
+        _extract_code_annotations_inner(root, language, highlights.get(), add);
         return *this;
     }
 
     /**
      * @brief Finds all the text annotations in a directory and returns them.
-     * Throws an exception if the path isn't a directory
+     * Reports a problem if the path isn't a directory
      *
      * @param root Root directory of the annotations
      * @return This builder (for chaining purposes)
@@ -75,7 +116,9 @@ struct AnnotationsBuilder {
         using namespace std::filesystem;
 
         if (!is_directory(root)) {
-            throw Exception(root.string() + " is not a directory.");
+            _diagnostics.add(
+                Diagnostic("io", root.string() + " is not a directory."));
+            return *this;
         }
 
         std::mutex mutex;
@@ -83,9 +126,12 @@ struct AnnotationsBuilder {
             _annotations.text_annotations;
         auto add = [&annotations, &mutex](std::string id, std::string title,
                                           std::string content,
-                                          std::vector<std::string> references) {
+                                          std::vector<std::string> references,
+                                          std::string file,
+                                          std::vector<int> reference_lines) {
             const std::lock_guard<std::mutex> lock_guard(mutex);
-            annotations.emplace_back(id, title, content, references);
+            annotations.emplace_back(id, title, content, references, file,
+                                     reference_lines);
         };
 
         _extract_text_annotations_inner(root, add);
@@ -93,14 +139,112 @@ struct AnnotationsBuilder {
     }
 
     /**
-     * @brief Returns the assembled annotations
+     * @brief Returns the assembled annotations, after the duplicate IDs are
+     * resolved
      *
      * @return Annotations
      */
-    Annotations get_annotations() { return _annotations; }
+    Annotations get_annotations() {
+        _resolve_duplicates();
+        return _annotations;
+    }
 
   private:
     Annotations _annotations;
+    IdRegistry _registry;
+    Diagnostics &_diagnostics;
+    std::mutex _duplicates_mutex;
+    std::map<std::string, std::vector<IdRegistry::Location>> _duplicates;
+
+    /**
+     * @brief Registers the ID of an extracted annotation. If another
+     * annotation with the same ID has already been extracted, either from a
+     * text annotation file or from the source code, the collision is found
+     * here, while the files are still being extracted, and the locations of
+     * both are kept for _resolve_duplicates(). The collision isn't reported
+     * yet: which annotation the threads registered first is a matter of
+     * chance, so a report made now would name a different location from run
+     * to run. Nothing is printed before extraction ends anyway
+     *
+     * @param id ID of the annotation
+     * @param file File in which the annotation was found
+     * @param line Line at which the annotation was found
+     */
+    void _register_id(const std::string &id, const std::string &file,
+                      int line) {
+        const IdRegistry::Location *first = _registry.insert(id, {file, line});
+        if (first == nullptr) {
+            return;
+        }
+        const std::lock_guard<std::mutex> lock_guard(_duplicates_mutex);
+        auto &locations = _duplicates[id];
+        if (locations.empty()) {
+            locations.push_back(*first);
+        }
+        locations.push_back({file, line});
+    }
+
+    /**
+     * @brief Keeps only the annotation with the smallest file and line of
+     * every duplicated ID, and reports the others in that order, each pointing
+     * at the kept one. The outcome doesn't depend on the order in which the
+     * files were extracted
+     */
+    void _resolve_duplicates() {
+        std::unordered_map<std::string, IdRegistry::Location> kept;
+        for (auto &[id, locations] : _duplicates) {
+            std::sort(locations.begin(), locations.end(),
+                      [](const IdRegistry::Location &a,
+                         const IdRegistry::Location &b) {
+                          return std::tie(a.file, a.line) <
+                                 std::tie(b.file, b.line);
+                      });
+            const IdRegistry::Location &first = locations.front();
+            for (std::size_t i = 1; i < locations.size(); i++) {
+                _diagnostics.add(Diagnostic(
+                    "duplicate",
+                    "There is already an annotation with ID '" + id +
+                        "' at " + first.file + ":" +
+                        std::to_string(first.line),
+                    locations[i].file, locations[i].line, id));
+            }
+            kept.emplace(id, first);
+        }
+        _duplicates.clear();
+        if (kept.empty()) {
+            return;
+        }
+
+        // Text annotations are one per file, code annotations are found at
+        // the line after their 0-based row
+        std::unordered_set<std::string> found;
+        auto keep = [&kept, &found](const std::string &id,
+                                    const std::string &file, int line) {
+            auto location = kept.find(id);
+            if (location == kept.end()) {
+                return true;
+            }
+            if (location->second.file != file ||
+                (line > 0 && location->second.line != line) ||
+                found.count(id) > 0) {
+                return false;
+            }
+            found.insert(id);
+            return true;
+        };
+        auto &text = _annotations.text_annotations;
+        text.erase(std::remove_if(text.begin(), text.end(),
+                                  [&keep](const TextAnnotation &a) {
+                                      return !keep(a.id, a.file, 0);
+                                  }),
+                   text.end());
+        auto &code = _annotations.code_annotations;
+        code.erase(std::remove_if(code.begin(), code.end(),
+                                  [&keep](const CodeAnnotation &a) {
+                                      return !keep(a.id, a.file, a.line + 1);
+                                  }),
+                   code.end());
+    }
 
     /**
      * @brief An inner function that extracts code annotations from a file, or
@@ -109,21 +253,25 @@ struct AnnotationsBuilder {
      * @tparam F function type for adding a code annotation to an array
      * @param path Path of the current file
      * @param language Language object
+     * @param highlights Compiled highlights query, or nullptr for no
+     * highlights
      * @param add Function that adds a code annotation to an array
      * @throw lect::Exception
      */
     template <typename F>
     void _extract_code_annotations_inner(const std::filesystem::path &path,
                                          const Language &language,
+                                         const TSQuery *highlights,
                                          F &add) noexcept(false) {
         using namespace std::filesystem;
         if (is_directory(path)) {
             std::vector<std::future<void>> futures;
             for (auto const &child : directory_iterator{path}) {
                 futures.push_back(std::async(
-                    std::launch::async, [child, &add, &language, this] {
-                        std::cout << std::this_thread::get_id() << "\n";
-                        _extract_code_annotations_inner(child, language, add);
+                    std::launch::async,
+                    [child, &add, &language, highlights, this] {
+                        _extract_code_annotations_inner(child, language,
+                                                        highlights, add);
                     }));
             }
             for (auto &fut : futures) {
@@ -159,8 +307,10 @@ struct AnnotationsBuilder {
                          language.query.size(), &error_offset, &query_error);
 
         if (query_error != 0) {
-            std::cout << "Issue with query at " << error_offset << " of kind "
-                      << query_error << "\n";
+            _diagnostics.add(Diagnostic(
+                "query", "Issue with the " + language.name + " query at " +
+                             std::to_string(error_offset) + " of kind " +
+                             std::to_string(query_error)));
             return;
         }
 
@@ -185,54 +335,39 @@ struct AnnotationsBuilder {
                 continue;
             }
 
+            std::string file = relative(path).string();
+            int row = ts_node_start_point(match.captures[0].node).row;
             uint64_t dollar = capture_comment.find_first_of("$");
-            uint64_t end_of_id = capture_comment.find_first_not_of(
-                "abcdefghijklmnopqrstuvwxyz-ABCDEFGHIJKLMNOPQRSTUVWXYZ",
-                dollar + 1);
-
-            if (end_of_id == std::string::npos) {
-                std::cout
-                    << color_red + "ERROR: " + color_reset + color_yellow +
-                           canonical(path).string() + color_reset + ":" +
-                           color_blue +
-                           std::to_string(
-                               ts_node_start_point(match.captures[0].node)
-                                   .row) +
-                           color_reset +
-                           "\n  The source code annotation directive doesn't "
-                           "have "
-                           "an "
-                           "identity\n"
-                           "  Example `//$identity Elaborate title`\n";
-                throw Exception(
-                    path.string() + " line " +
-                    std::to_string(
-                        ts_node_start_point(match.captures[0].node).row));
+            uint64_t end_of_id = find_id_end(capture_comment, dollar + 1);
+
+            if (end_of_id == dollar + 1) {
+                _diagnostics.add(Diagnostic(
+                    "directive",
+                    "The source code annotation directive doesn't have an "
+                    "identity\n"
+                    "  Example `//$identity Elaborate title`",
+                    file, row + 1));
+                continue;
             }
             std::string id =
                 capture_comment.substr(dollar + 1, end_of_id - dollar - 1);
-            std::string title = capture_comment.substr(end_of_id + 1);
+            std::string title = end_of_id < capture_comment.size()
+                                    ? capture_comment.substr(end_of_id + 1)
+                                    : "";
             if (title.find_first_not_of("\n ") == std::string::npos) {
-                std::cout << color_red + "ERROR: " + color_reset +
-                                 color_yellow + canonical(path).string() +
-                                 color_reset + ":" + color_blue +
-                                 std::to_string(
-                                     ts_node_start_point(match.captures[0].node)
-                                         .row) +
-                                 color_reset +
-                                 "\n  The source code annotation directive "
-                                 "doesn't have "
-                                 "a "
-                                 "title\n"
-                                 "  Example `//$identity Elaborate title`\n";
-                throw Exception(
-                    path.string() + " line " +
-                    std::to_string(
-                        ts_node_start_point(match.captures[0].node).row));
+                _diagnostics.add(Diagnostic(
+                    "directive",
+                    "The source code annotation directive doesn't have a "
+                    "title\n"
+                    "  Example `//$identity Elaborate title`",
+                    file, row + 1, id));
+                continue;
             }
 
-            add(id, title, capture_object, relative(path).string(),
-                ts_node_start_point(match.captures[0].node).row);
+            _register_id(id, file, row + 1);
+            add(id, title, capture_object, file, row,
+                collect_highlights(highlights, ts_tree_root_node(tree),
+                                   start_object, end_object));
         }
     }
 
@@ -255,7 +390,6 @@ struct AnnotationsBuilder {
                  directory_iterator{path}) {
                 futures.push_back(
                     std::async(std::launch::async, [child, &add, this] {
-                        std::cout << std::this_thread::get_id() << "\n";
                         _extract_text_annotations_inner(child, add);
                     }));
             }
@@ -276,12 +410,25 @@ struct AnnotationsBuilder {
         std::ifstream file(path);
         bool first = true;
 
+        std::string file_name = relative(path).string();
         std::string id(path.stem().string());
+        if (!is_valid_id(id)) {
+            _diagnostics.add(
+                Diagnostic("invalid-id",
+                           "The file name `" + id +
+                               "` isn't a valid annotation ID.\n"
+                               "  Only latin letters and hyphens are allowed",
+                           file_name, 0, id));
+            return;
+        }
         std::string title;
         std::string content;
         std::string current_line;
         std::vector<std::string> references;
+        std::vector<int> reference_lines;
         int line_counter = 1;
+        int title_line = 1;
+        int content_line = 1;
 
         while (std::getline(file, current_line)) {
             if (first &&
@@ -291,23 +438,20 @@ struct AnnotationsBuilder {
             }
             if (first) {
                 first = false;
-                if (current_line.at(0) == '#' && current_line.at(1) == ' ') {
+                if (current_line.size() > 1 && current_line.at(0) == '#' &&
+                    current_line.at(1) == ' ') {
                     title = current_line.substr(2);
+                    title_line = line_counter;
+                    content_line = line_counter + 1;
                 } else {
-                    std::cout
-                        << color_red + "ERROR: " + color_reset + color_yellow
-                        << canonical(path).string() + color_reset + ":" +
-                               color_blue + std::to_string(line_counter) +
-                               color_reset +
-                               "\n  The file doesn't follow the text "
-                               "annotation format.\n"
-                               "  First line of the file should be `#` "
-                               "followed by the "
-                               "annotations title.\n"
-                               "  Example: `# Elaborate annotation "
-                               "title`\n";
-                    throw Exception(path.string() +
-                                    " doesn't have a proper title");
+                    _diagnostics.add(Diagnostic(
+                        "format",
+                        "The file doesn't follow the text annotation format.\n"
+                        "  First line of the file should be `#` followed by "
+                        "the annotations title.\n"
+                        "  Example: `# Elaborate annotation title`",
+                        file_name, line_counter, id));
+                    return;
                 }
                 line_counter++;
                 continue;
@@ -317,31 +461,41 @@ struct AnnotationsBuilder {
             content += '\n';
         }
         if (content.size() < 1) {
-            std::cout << color_red + "ERROR: " + color_reset + color_yellow
-                      << canonical(path).string() + color_reset + ":" +
-                             color_blue + std::to_string(line_counter) +
-                             color_reset +
-                             "\n  The file doesn't follow the text "
-                             "annotation format.\n"
-                             "  Annotation contains no body after the title\n"
-                             "  Example: `# Elaborate annotation "
-                             "title`\n";
-            throw Exception(path.string() + " doesn't have a proper title");
+            _diagnostics.add(Diagnostic(
+                "format",
+                "The file doesn't follow the text annotation format.\n"
+                "  Annotation contains no body after the title\n"
+                "  Example: `# Elaborate annotation title`",
+                file_name, line_counter, id));
+            return;
         }
-        while (content.at(0) == '\n') {
-            content = content.substr(1);
+        std::size_t leading = content.find_first_not_of('\n');
+        if (leading == std::string::npos) {
+            leading = content.size() - 1;
         }
+        content_line += leading;
+        content.erase(0, leading);
 
-        std::size_t next_pos = content.find('$');
-        while (next_pos != std::string::npos && next_pos < content.size()) {
-            std::size_t end_pos = content.find_first_not_of(
-                "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ-",
-                next_pos + 1);
-            references.push_back(
-                content.substr(next_pos + 1, end_pos - next_pos - 1));
-            next_pos = content.find('$', end_pos);
-        }
-        add(id, title, content, references);
+        std::size_t line_pos = 0;
+        int reference_line = content_line;
+        scan_references(content, [&](std::string_view ref,
+                                     std::size_t position) {
+            reference_line += std::count(content.begin() + line_pos,
+                                         content.begin() + position, '\n');
+            line_pos = position;
+            if (ref.empty()) {
+                _diagnostics.add(Diagnostic(
+                    "reference",
+                    "A `$` isn't followed by an annotation ID.\n"
+                    "  IDs can contain only latin letters and hyphens",
+                    file_name, reference_line, id));
+                return;
+            }
+            references.emplace_back(ref);
+            reference_lines.push_back(reference_line);
+        });
+        _register_id(id, file_name, title_line);
+        add(id, title, content, references, file_name, reference_lines);
         return;
     }
 };
@@ -0,0 +1,176 @@
+/**
+ * @file files.hpp
+ * @brief Functions that replace files atomically and only when their content
+ * changes
+ */
+
+#pragma once
+
+#include "structures.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace lect {
+
+/**
+ * @brief Path of the temporary file that is written before it replaces the
+ * file at path
+ *
+ * @param path Path of the file
+ * @return Path of the temporary file in the same directory
+ */
+inline std::filesystem::path temp_path(const std::filesystem::path &path) {
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+    return temp;
+}
+
+/**
+ * @brief Checks whether two files have the same content. The sizes are
+ * compared first, so differing files are usually told apart without reading
+ * them
+ *
+ * @param a Path of the first file
+ * @param b Path of the second file
+ * @return true if both files exist and are identical, false otherwise
+ */
+inline bool same_content(const std::filesystem::path &a,
+                         const std::filesystem::path &b) {
+    std::error_code error;
+    auto size = std::filesystem::file_size(a, error);
+    if (error || size != std::filesystem::file_size(b, error) || error) {
+        return false;
+    }
+
+    std::ifstream first(a, std::ios::binary);
+    std::ifstream second(b, std::ios::binary);
+    std::string first_block(1 << 16, '\0');
+    std::string second_block(1 << 16, '\0');
+    while (first && second) {
+        first.read(first_block.data(), first_block.size());
+        second.read(second_block.data(), second_block.size());
+        if (first.gcount() != second.gcount() ||
+            first_block.compare(0, first.gcount(), second_block, 0,
+                                second.gcount()) != 0) {
+            return false;
+        }
+    }
+    return first.eof() && second.eof();
+}
+
+/**
+ * @brief Checks whether a file has the given content
+ *
+ * @param path Path of the file
+ * @param content Expected content
+ * @return true if the file exists and has the content, false otherwise
+ */
+inline bool same_content(const std::filesystem::path &path,
+                         std::string_view content) {
+    std::error_code error;
+    auto size = std::filesystem::file_size(path, error);
+    if (error || size != content.size()) {
+        return false;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::string block(1 << 16, '\0');
+    std::size_t position = 0;
+    while (file && position < content.size()) {
+        file.read(block.data(), block.size());
+        std::size_t read = file.gcount();
+        if (content.compare(position, read, block.data(), read) != 0) {
+            return false;
+        }
+        position += read;
+    }
+    return position == content.size();
+}
+
+/**
+ * @brief Atomically moves a temporary file over the file at path
+ *
+ * @param temp Path of the temporary file
+ * @param path Path of the file to replace
+ * @throw lect::Exception
+ */
+inline void _rename(const std::filesystem::path &temp,
+                    const std::filesystem::path &path) noexcept(false) {
+    std::error_code error;
+    std::filesystem::rename(temp, path, error);
+    if (error) {
+        std::filesystem::remove(temp, error);
+        throw Exception("Couldn't write `" + path.string() + "`");
+    }
+}
+
+/**
+ * @brief Moves a finished temporary file over the file at path, unless the
+ * file already has the same content, in which case it's left untouched and
+ * the temporary file is removed. The rename is atomic, so readers see either
+ * the old or the new file, never a partially written one
+ *
+ * @param temp Path of the temporary file
+ * @param path Path of the file to replace
+ * @return true if the file was replaced, false if it was already up to date
+ * @throw lect::Exception
+ */
+inline bool replace_if_changed(const std::filesystem::path &temp,
+                               const std::filesystem::path &path) noexcept(
+    false) {
+    if (same_content(temp, path)) {
+        std::error_code error;
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+    _rename(temp, path);
+    return true;
+}
+
+/**
+ * @brief Removes the file at path, if there is one. A directory is removed
+ * with everything in it
+ *
+ * @param path Path of the file or directory
+ * @throw lect::Exception
+ */
+inline void remove_if_exists(const std::filesystem::path &path) noexcept(
+    false) {
+    std::error_code error;
+    std::filesystem::remove_all(path, error);
+    if (error) {
+        throw Exception("Couldn't remove `" + path.string() + "`");
+    }
+}
+
+/**
+ * @brief Writes the content to the file at path through a temporary file,
+ * unless the file already has the same content
+ *
+ * @param path Path of the file
+ * @param content Content to write
+ * @return true if the file was written, false if it was already up to date
+ * @throw lect::Exception
+ */
+inline bool write_if_changed(const std::filesystem::path &path,
+                             std::string_view content) noexcept(false) {
+    if (same_content(path, content)) {
+        return false;
+    }
+    std::filesystem::path temp = temp_path(path);
+    std::ofstream file(temp, std::ios::binary);
+    file.write(content.data(), content.size());
+    file.close();
+    if (!file) {
+        std::error_code error;
+        std::filesystem::remove(temp, error);
+        throw Exception("Couldn't write `" + path.string() + "`");
+    }
+    _rename(temp, path);
+    return true;
+}
+
+} // namespace lect
@@ -0,0 +1,291 @@
+/**
+ * @file graph.hpp
+ * @brief An immutable graph of references between annotations, shared by the
+ * checkers and the preprocessing stages
+ */
+
+#pragma once
+
+#include "structures.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lect {
+
+//$annotation-graph-src Annotation graph
+/**
+ * @class AnnotationGraph
+ * @brief A graph of the references between annotations, stored in compressed
+ * sparse row form. Nodes are numbered with text annotations first, followed by
+ * code annotations, in the same order as in the Annotations object
+ *
+ */
+struct AnnotationGraph {
+    /**
+     * @class Range
+     * @brief A view over a contiguous range of node indices
+     *
+     */
+    struct Range {
+        const uint32_t *first;
+        const uint32_t *last;
+
+        const uint32_t *begin() const { return first; }
+        const uint32_t *end() const { return last; }
+        uint32_t size() const { return last - first; }
+    };
+
+    /**
+     * @class DanglingReference
+     * @brief A reference to an annotation that doesn't exist
+     *
+     */
+    struct DanglingReference {
+        uint32_t node;
+        std::string id;
+    };
+
+    /**
+     * @brief Builds the graph out of the extracted annotations. References to
+     * nonexistent annotations aren't turned into edges, but are stored in
+     * dangling instead. If several annotations share an ID, references resolve
+     * to the first one
+     *
+     * @param annotations Annotations to build the graph from
+     * @return The graph
+     */
+    static AnnotationGraph build(const Annotations &annotations) {
+        AnnotationGraph graph;
+        graph.text_count = annotations.text_annotations.size();
+        uint32_t count = graph.text_count + annotations.code_annotations.size();
+
+        graph.ids.reserve(count);
+        graph.index.reserve(count);
+        for (const auto &a : annotations.text_annotations) {
+            graph.index.insert({a.id, graph.ids.size()});
+            graph.ids.push_back(a.id);
+        }
+        for (const auto &a : annotations.code_annotations) {
+            graph.index.insert({a.id, graph.ids.size()});
+            graph.ids.push_back(a.id);
+        }
+
+        std::vector<uint32_t> seen(count, UINT32_MAX);
+        graph.offsets.reserve(count + 1);
+        graph.offsets.push_back(0);
+        for (uint32_t node = 0; node < graph.text_count; node++) {
+            const auto &references =
+                annotations.text_annotations[node].references;
+            for (const auto &ref : references) {
+                auto found = graph.index.find(ref);
+                if (found == graph.index.end()) {
+                    graph.dangling.push_back({node, ref});
+                    continue;
+                }
+                if (seen[found->second] == node) {
+                    continue;
+                }
+                seen[found->second] = node;
+                graph.targets.push_back(found->second);
+            }
+            graph.offsets.push_back(graph.targets.size());
+        }
+        graph.offsets.resize(count + 1, graph.targets.size());
+
+        graph.reverse_offsets.assign(count + 1, 0);
+        for (uint32_t target : graph.targets) {
+            graph.reverse_offsets[target + 1]++;
+        }
+        for (uint32_t node = 0; node < count; node++) {
+            graph.reverse_offsets[node + 1] += graph.reverse_offsets[node];
+        }
+        graph.reverse_targets.resize(graph.targets.size());
+        std::vector<uint32_t> fill(graph.reverse_offsets.begin(),
+                                   graph.reverse_offsets.end() - 1);
+        for (uint32_t node = 0; node < count; node++) {
+            for (uint32_t target : graph.children(node)) {
+                graph.reverse_targets[fill[target]++] = node;
+            }
+        }
+
+        for (uint32_t node = 0; node < count; node++) {
+            if (graph.in_degree(node) == 0) {
+                graph.roots.push_back(node);
+            }
+            if (graph.out_degree(node) == 0) {
+                graph.leaves.push_back(node);
+            }
+        }
+
+        return graph;
+    }
+
+    /**
+     * @brief Number of nodes in the graph
+     *
+     * @return Number of nodes
+     */
+    uint32_t size() const { return ids.size(); }
+
+    /**
+     * @brief Checks whether a node is a text annotation
+     *
+     * @param node Node index
+     * @return true if it's a text annotation, false if it's a code annotation
+     */
+    bool is_text(uint32_t node) const { return node < text_count; }
+
+    /**
+     * @brief Looks up the node of an annotation by its ID
+     *
+     * @param id ID of the annotation
+     * @return Node index, or nothing if there is no such annotation
+     */
+    std::optional<uint32_t> find(const std::string &id) const {
+        auto found = index.find(id);
+        if (found == index.end()) {
+            return std::nullopt;
+        }
+        return found->second;
+    }
+
+    /**
+     * @brief Nodes referenced by a node
+     *
+     * @param node Node index
+     * @return Range of referenced nodes
+     */
+    Range children(uint32_t node) const {
+        return {targets.data() + offsets[node],
+                targets.data() + offsets[node + 1]};
+    }
+
+    /**
+     * @brief Nodes that reference a node
+     *
+     * @param node Node index
+     * @return Range of referencing nodes
+     */
+    Range parents(uint32_t node) const {
+        return {reverse_targets.data() + reverse_offsets[node],
+                reverse_targets.data() + reverse_offsets[node + 1]};
+    }
+
+    /**
+     * @brief Number of nodes that reference a node
+     *
+     * @param node Node index
+     * @return In-degree
+     */
+    uint32_t in_degree(uint32_t node) const {
+        return reverse_offsets[node + 1] - reverse_offsets[node];
+    }
+
+    /**
+     * @brief Number of nodes referenced by a node
+     *
+     * @param node Node index
+     * @return Out-degree
+     */
+    uint32_t out_degree(uint32_t node) const {
+        return offsets[node + 1] - offsets[node];
+    }
+
+    /**
+     * @brief Finds the strongly connected components of the graph that can be
+     * reached from the starting nodes, using an iterative version of Tarjan's
+     * algorithm. Runs in linear time of the reached part of the graph and
+     * doesn't depend on its depth
+     *
+     * @param starts Nodes to start from
+     * @return Components, each one a list of its nodes
+     */
+    std::vector<std::vector<uint32_t>>
+    components(const std::vector<uint32_t> &starts) const {
+        const uint32_t unvisited = UINT32_MAX;
+        std::vector<uint32_t> index(size(), unvisited);
+        std::vector<uint32_t> low(size(), 0);
+        std::vector<bool> on_stack(size(), false);
+        std::vector<uint32_t> stack;
+        std::vector<std::pair<uint32_t, uint32_t>> calls;
+        std::vector<std::vector<uint32_t>> found;
+        uint32_t counter = 0;
+
+        for (uint32_t start : starts) {
+            if (index[start] != unvisited) {
+                continue;
+            }
+            calls.push_back({start, 0});
+            while (!calls.empty()) {
+                auto &[node, edge] = calls.back();
+                if (edge == 0) {
+                    index[node] = low[node] = counter++;
+                    stack.push_back(node);
+                    on_stack[node] = true;
+                }
+                Range next = children(node);
+                if (edge < next.size()) {
+                    uint32_t child = next.begin()[edge++];
+                    if (index[child] == unvisited) {
+                        calls.push_back({child, 0});
+                    } else if (on_stack[child]) {
+                        low[node] = std::min(low[node], index[child]);
+                    }
+                    continue;
+                }
+
+                uint32_t finished = node;
+                calls.pop_back();
+                if (!calls.empty()) {
+                    uint32_t parent = calls.back().first;
+                    low[parent] = std::min(low[parent], low[finished]);
+                }
+                if (low[finished] != index[finished]) {
+                    continue;
+                }
+                std::vector<uint32_t> component;
+                uint32_t member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    on_stack[member] = false;
+                    component.push_back(member);
+                } while (member != finished);
+                found.push_back(std::move(component));
+            }
+        }
+
+        return found;
+    }
+
+    /**
+     * @brief Finds all strongly connected components of the graph
+     *
+     * @return Components, each one a list of its nodes
+     */
+    std::vector<std::vector<uint32_t>> components() const {
+        std::vector<uint32_t> all(size());
+        for (uint32_t node = 0; node < size(); node++) {
+            all[node] = node;
+        }
+        return components(all);
+    }
+
+    std::vector<std::string> ids;
+    std::unordered_map<std::string, uint32_t> index;
+    uint32_t text_count = 0;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> targets;
+    std::vector<uint32_t> reverse_offsets;
+    std::vector<uint32_t> reverse_targets;
+    std::vector<uint32_t> roots;
+    std::vector<uint32_t> leaves;
+    std::vector<DanglingReference> dangling;
+};
+
+} // namespace lect
@@ -0,0 +1,145 @@
+/**
+ * @file groups.hpp
+ * @brief Groups of annotations that the viewer collapses into single nodes
+ * when a large graph is zoomed out
+ */
+
+#pragma once
+
+#include "structures.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace lect {
+
+//$groups-src Annotation groups
+/**
+ * @class Groups
+ * @brief A partition of the nodes of the reference graph into groups, stored
+ * like the graph: the members of group i are members[offsets[i]] to
+ * members[offsets[i + 1]]. Every root with references gets a group with the
+ * nodes it reaches that no earlier root reaches. Nodes without any references
+ * are grouped by the directory of their file. Groups of a single node are
+ * left out, because there is nothing to collapse
+ *
+ */
+struct Groups {
+    std::vector<std::string> labels;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> members;
+
+    /**
+     * @brief Groups the nodes of the reference graph
+     *
+     * @param annotations Annotations of the graph, numbered like its nodes
+     * @param offsets Offsets of the edges of every node
+     * @param targets Targets of the edges
+     * @return Groups
+     */
+    static Groups compute(const Annotations &annotations,
+                          const std::vector<uint32_t> &offsets,
+                          const std::vector<uint32_t> &targets) {
+        uint32_t count = offsets.empty() ? 0 : offsets.size() - 1;
+        std::vector<uint32_t> in_degree(count, 0);
+        for (uint32_t target : targets) {
+            in_degree[target]++;
+        }
+
+        Groups groups;
+        groups.offsets.push_back(0);
+        std::vector<bool> assigned(count, false);
+        std::vector<uint32_t> stack;
+        for (uint32_t root = 0; root < count; root++) {
+            if (in_degree[root] != 0 || offsets[root] == offsets[root + 1]) {
+                continue;
+            }
+            std::size_t first = groups.members.size();
+            assigned[root] = true;
+            stack.push_back(root);
+            while (!stack.empty()) {
+                uint32_t node = stack.back();
+                stack.pop_back();
+                groups.members.push_back(node);
+                for (uint32_t i = offsets[node]; i < offsets[node + 1]; i++) {
+                    if (!assigned[targets[i]]) {
+                        assigned[targets[i]] = true;
+                        stack.push_back(targets[i]);
+                    }
+                }
+            }
+            groups._close(first, _id(annotations, root));
+        }
+
+        // Isolated nodes, and nodes on cycles no root reaches
+        std::map<std::string, std::vector<uint32_t>> directories;
+        for (uint32_t node = 0; node < count; node++) {
+            if (!assigned[node]) {
+                std::string directory =
+                    std::filesystem::path(_file(annotations, node))
+                        .parent_path()
+                        .string();
+                directories[directory.empty() ? "." : directory].push_back(
+                    node);
+            }
+        }
+        for (auto &[directory, nodes] : directories) {
+            std::size_t first = groups.members.size();
+            groups.members.insert(groups.members.end(), nodes.begin(),
+                                  nodes.end());
+            groups._close(first, directory);
+        }
+        return groups;
+    }
+
+  private:
+    /**
+     * @brief Ends the group whose members start at first, or drops it if it
+     * has a single member
+     *
+     * @param first Position of the first member of the group
+     * @param label Label of the group
+     */
+    void _close(std::size_t first, const std::string &label) {
+        if (members.size() - first < 2) {
+            members.resize(first);
+            return;
+        }
+        std::sort(members.begin() + first, members.end());
+        labels.push_back(label);
+        offsets.push_back(members.size());
+    }
+
+    /**
+     * @brief ID of the annotation of a node
+     *
+     * @param annotations Annotations of the graph
+     * @param node Node of the graph
+     * @return ID of the annotation
+     */
+    static const std::string &_id(const Annotations &annotations,
+                                  uint32_t node) {
+        std::size_t text = annotations.text_annotations.size();
+        return node < text ? annotations.text_annotations[node].id
+                           : annotations.code_annotations[node - text].id;
+    }
+
+    /**
+     * @brief File in which the annotation of a node was found
+     *
+     * @param annotations Annotations of the graph
+     * @param node Node of the graph
+     * @return Path of the file
+     */
+    static const std::string &_file(const Annotations &annotations,
+                                    uint32_t node) {
+        std::size_t text = annotations.text_annotations.size();
+        return node < text ? annotations.text_annotations[node].file
+                           : annotations.code_annotations[node - text].file;
+    }
+};
+
+} // namespace lect
@@ -0,0 +1,104 @@
+/**
+ * @file highlight.hpp
+ * @brief Syntax highlighting of the code annotations, found with a tree-sitter
+ * query during extraction and rendered into HTML at export time
+ */
+
+#pragma once
+
+#include "html.hpp"
+#include "structures.hpp"
+#include "tree_sitter/api.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lect {
+
+/**
+ * @brief Collects the highlighted ranges of a part of a parsed file. Captures
+ * are clipped to the part, and of overlapping ones only the outermost is
+ * kept, so the ranges can be rendered as flat spans
+ *
+ * @param query Highlights query, or nullptr for no highlights
+ * @param root Root node of the parsed file
+ * @param start Byte at which the part starts
+ * @param end Byte at which the part ends
+ * @return Ranges relative to the start of the part, in order
+ */
+inline std::vector<Highlight> collect_highlights(const TSQuery *query,
+                                                 TSNode root, uint32_t start,
+                                                 uint32_t end) {
+    std::vector<Highlight> highlights;
+    if (query == nullptr) {
+        return highlights;
+    }
+
+    TSQueryCursor *cursor = ts_query_cursor_new();
+    ts_query_cursor_set_byte_range(cursor, start, end);
+    ts_query_cursor_exec(cursor, query, root);
+    TSQueryMatch match;
+    uint32_t index;
+    while (ts_query_cursor_next_capture(cursor, &match, &index)) {
+        const TSQueryCapture &capture = match.captures[index];
+        uint32_t from = std::max(ts_node_start_byte(capture.node), start);
+        uint32_t to = std::min(ts_node_end_byte(capture.node), end);
+        if (from >= to) {
+            continue;
+        }
+        uint32_t length;
+        const char *name =
+            ts_query_capture_name_for_id(query, capture.index, &length);
+        highlights.push_back({from - start, to - start, {name, length}});
+    }
+    ts_query_cursor_delete(cursor);
+
+    std::stable_sort(highlights.begin(), highlights.end(),
+                     [](const Highlight &a, const Highlight &b) {
+                         return a.start < b.start ||
+                                (a.start == b.start && a.end > b.end);
+                     });
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < highlights.size(); i++) {
+        if (kept == 0 || highlights[i].start >= highlights[kept - 1].end) {
+            highlights[kept++] = std::move(highlights[i]);
+        }
+    }
+    highlights.resize(kept);
+    return highlights;
+}
+
+//$highlight-src Syntax highlighting
+/**
+ * @brief Renders the content of a code annotation as escaped HTML, with every
+ * highlighted range wrapped in a span of class `hl-<kind>`. The viewer shows
+ * it with whitespace preserved, so it's inserted as it is
+ *
+ * @param annotation Code annotation to render
+ * @return HTML of the content
+ */
+inline std::string highlight_html(const CodeAnnotation &annotation) {
+    std::string_view content = annotation.content;
+    std::string html;
+    html.reserve(content.size() + content.size() / 4);
+    std::size_t position = 0;
+    for (const auto &highlight : annotation.highlights) {
+        if (highlight.start < position || highlight.end > content.size()) {
+            continue;
+        }
+        escape_html(html, content.substr(position, highlight.start - position));
+        html += "<span class=\"hl-";
+        html += highlight.kind;
+        html += "\">";
+        escape_html(html, content.substr(highlight.start,
+                                         highlight.end - highlight.start));
+        html += "</span>";
+        position = highlight.end;
+    }
+    escape_html(html, content.substr(position));
+    return html;
+}
+
+} // namespace lect
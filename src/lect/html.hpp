@@ -0,0 +1,117 @@
+/**
+ * @file html.hpp
+ * @brief Rendering of the contents of the annotations into the HTML that the
+ * viewer inserts as it is
+ */
+
+#pragma once
+
+#include "scan.hpp"
+#include "structures.hpp"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace lect {
+
+/**
+ * @brief Appends text to HTML, escaping the characters that would be read as
+ * markup
+ *
+ * @param html HTML to append to
+ * @param text Text to append
+ */
+inline void escape_html(std::string &html, std::string_view text) {
+    for (char c : text) {
+        switch (c) {
+        case '&':
+            html += "&amp;";
+            break;
+        case '<':
+            html += "&lt;";
+            break;
+        case '>':
+            html += "&gt;";
+            break;
+        case '"':
+            html += "&quot;";
+            break;
+        case '\'':
+            html += "&#39;";
+            break;
+        default:
+            html += c;
+        }
+    }
+}
+
+/**
+ * @brief Appends prose to HTML. Besides being escaped, line breaks become
+ * `<br/>` and the spaces that indent a line become non-breaking, so the lines
+ * keep their indentation
+ *
+ * @param html HTML to append to
+ * @param text Text to append
+ * @param line_start Whether the text starts a line. Updated to whether the
+ * next text does
+ */
+inline void _prose_html(std::string &html, std::string_view text,
+                        bool &line_start) {
+    std::size_t position = 0;
+    while (position < text.size()) {
+        if (line_start) {
+            while (position < text.size() && text[position] == ' ') {
+                html += "&#x00A0;";
+                position++;
+            }
+            line_start = false;
+        }
+        std::size_t newline = text.find('\n', position);
+        if (newline == std::string_view::npos) {
+            escape_html(html, text.substr(position));
+            return;
+        }
+        escape_html(html, text.substr(position, newline - position));
+        html += "<br/>";
+        position = newline + 1;
+        line_start = true;
+    }
+}
+
+//$text-html-src Text annotation HTML
+/**
+ * @brief Renders the content of a text annotation as escaped HTML, with every
+ * reference turned into a link that displays the referenced annotation. The
+ * references are found by the same scan as during extraction, so the content
+ * is read once no matter how many references it has
+ *
+ * @param annotation Text annotation to render
+ * @return HTML of the content
+ */
+inline std::string text_html(const TextAnnotation &annotation) {
+    std::string_view content = annotation.content;
+    std::string html;
+    html.reserve(content.size() + content.size() / 8);
+    std::size_t position = 0;
+    bool line_start = true;
+    scan_references(content, [&](std::string_view ref, std::size_t dollar) {
+        if (ref.empty()) {
+            return;
+        }
+        _prose_html(html, content.substr(position, dollar - position),
+                    line_start);
+        html += "<a href=\"#";
+        html += ref;
+        html += "\" onclick=\"onRefClick('";
+        html += ref;
+        html += "')\">$";
+        html += ref;
+        html += "</a>";
+        position = dollar + 1 + ref.size();
+        line_start = false;
+    });
+    _prose_html(html, content.substr(position), line_start);
+    return html;
+}
+
+} // namespace lect
@@ -0,0 +1,321 @@
+/**
+ * @file incremental.hpp
+ * @brief A cache of the previous check results, which makes it possible to
+ * re-check only the annotations affected by a change
+ */
+
+#pragma once
+
+#include "checks.hpp"
+#include "diagnostics.hpp"
+#include "graph.hpp"
+#include "nlohmann/json.hpp"
+#include "structures.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace lect {
+
+/**
+ * @class ChangeSet
+ * @brief IDs of the annotations that changed since the previous check
+ *
+ */
+struct ChangeSet {
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    std::vector<std::string> modified;
+
+    /**
+     * @brief Checks whether nothing changed
+     *
+     * @return true if there are no changes, false otherwise
+     */
+    bool empty() const {
+        return added.empty() && removed.empty() && modified.empty();
+    }
+};
+
+//$validation-state-src Validation state
+/**
+ * @class ValidationState
+ * @brief Fingerprints of the annotations and the problems the checkers found
+ * in them during the previous run. When the annotations change, only the
+ * changed ones, the ones referencing them and the cycles they belong to are
+ * checked again, and the rest of the problems are taken from the previous run
+ *
+ */
+struct ValidationState {
+    /**
+     * @brief Loads the state of the previous run. A missing or unreadable file
+     * results in an empty state, which makes the next check a full one
+     *
+     * @param path Path of the state file
+     * @return The state
+     */
+    static ValidationState load(const std::filesystem::path &path) {
+        using namespace nlohmann;
+        ValidationState state;
+        std::ifstream file(path);
+        if (!file) {
+            return state;
+        }
+        json document = json::parse(file, nullptr, false);
+        if (!document.is_object() || document.value("version", 0) != version) {
+            return state;
+        }
+        try {
+            state._configuration = document.at("configuration");
+            state._fingerprints = document.at("fingerprints")
+                                      .get<std::unordered_map<std::string,
+                                                              std::string>>();
+            for (const auto &d : document.at("diagnostics")) {
+                state._diagnostics.push_back(
+                    Diagnostic(d.at("kind"), d.at("message"), d.at("file"),
+                               d.at("line"), d.at("id"), d.at("related")));
+            }
+        } catch (const json::exception &) {
+            return ValidationState();
+        }
+        state._valid = true;
+        return state;
+    }
+
+    /**
+     * @brief Writes the state to a file
+     *
+     * @param path Path of the state file
+     * @throw lect::Exception
+     */
+    void save(const std::filesystem::path &path) const noexcept(false) {
+        using namespace nlohmann;
+        json diagnostics = json::array();
+        for (const auto &d : _diagnostics) {
+            diagnostics.push_back({{"kind", d.kind},
+                                   {"message", d.message},
+                                   {"file", d.file},
+                                   {"line", d.line},
+                                   {"id", d.id},
+                                   {"related", d.related}});
+        }
+        json document = {{"version", version},
+                         {"configuration", _configuration},
+                         {"fingerprints", _fingerprints},
+                         {"diagnostics", diagnostics}};
+
+        std::ofstream file(path);
+        if (!file) {
+            throw Exception("Couldn't write the validation cache to `" +
+                            path.string() + "`");
+        }
+        file << document.dump();
+    }
+
+    /**
+     * @brief Compares the annotations with the ones of the previous run
+     *
+     * @param annotations Current annotations
+     * @return IDs of the added, removed and modified annotations
+     */
+    ChangeSet changes(const Annotations &annotations) const {
+        auto current = _fingerprint(annotations);
+        ChangeSet changes;
+        for (const auto &[id, fingerprint] : current) {
+            auto previous = _fingerprints.find(id);
+            if (previous == _fingerprints.end()) {
+                changes.added.push_back(id);
+            } else if (previous->second != fingerprint) {
+                changes.modified.push_back(id);
+            }
+        }
+        for (const auto &[id, fingerprint] : _fingerprints) {
+            if (current.find(id) == current.end()) {
+                changes.removed.push_back(id);
+            }
+        }
+        return changes;
+    }
+
+    /**
+     * @brief Checks the annotations, reusing the results of the previous run
+     * where possible, and remembers the results for the next one. Falls back
+     * to a full check if there is no previous run or the checkers changed
+     *
+     * @param checker Chain of checkers to run
+     * @param annotations Annotations to check
+     * @param graph Reference graph of the annotations
+     * @param diagnostics Collector of the found problems
+     * @throw lect::Exception
+     */
+    void check(Checker &checker, const Annotations &annotations,
+               const AnnotationGraph &graph,
+               Diagnostics &diagnostics) noexcept(false) {
+        Diagnostics found;
+        std::vector<Diagnostic> kept;
+        std::string configuration = checker.chain_configuration();
+
+        if (!_valid || configuration != _configuration) {
+            checker.check(annotations, graph, found);
+        } else {
+            ChangeSet changed = changes(annotations);
+            std::unordered_set<std::string> dirty(changed.added.begin(),
+                                                  changed.added.end());
+            dirty.insert(changed.modified.begin(), changed.modified.end());
+            std::unordered_set<std::string> removed(changed.removed.begin(),
+                                                    changed.removed.end());
+
+            std::vector<bool> scope = _affected(graph, dirty, removed);
+            std::unordered_set<std::string> stale = removed;
+            for (uint32_t node = 0; node < graph.size(); node++) {
+                if (scope[node]) {
+                    stale.insert(graph.ids[node]);
+                }
+            }
+
+            if (changed.empty()) {
+                kept = _diagnostics;
+            } else {
+                for (const auto &d : _diagnostics) {
+                    if (!_is_stale(d, stale)) {
+                        kept.push_back(d);
+                    }
+                }
+                checker.check(annotations, graph, found, &scope);
+            }
+        }
+
+        for (auto &d : found.sorted()) {
+            if (std::find(kept.begin(), kept.end(), d) == kept.end()) {
+                kept.push_back(std::move(d));
+            }
+        }
+        for (const auto &d : kept) {
+            diagnostics.add(d);
+        }
+
+        _diagnostics = std::move(kept);
+        _configuration = configuration;
+        _fingerprints = _fingerprint(annotations);
+        _valid = true;
+    }
+
+  private:
+    static constexpr int version = 1;
+
+    /**
+     * @brief Finds the nodes whose results may have changed: the changed
+     * annotations, the ones that reference them, and the ones that referenced
+     * a removed annotation
+     *
+     * @param graph Reference graph of the annotations
+     * @param dirty IDs of the added and modified annotations
+     * @param removed IDs of the removed annotations
+     * @return Flags of the affected nodes
+     */
+    static std::vector<bool>
+    _affected(const AnnotationGraph &graph,
+              const std::unordered_set<std::string> &dirty,
+              const std::unordered_set<std::string> &removed) {
+        std::vector<bool> scope(graph.size(), false);
+        for (uint32_t node = 0; node < graph.size(); node++) {
+            if (dirty.find(graph.ids[node]) == dirty.end()) {
+                continue;
+            }
+            scope[node] = true;
+            for (uint32_t parent : graph.parents(node)) {
+                scope[parent] = true;
+            }
+        }
+        for (const auto &reference : graph.dangling) {
+            if (removed.find(reference.id) != removed.end()) {
+                scope[reference.node] = true;
+            }
+        }
+        return scope;
+    }
+
+    /**
+     * @brief Checks whether a diagnostic of the previous run has to be found
+     * again. Diagnostics that aren't tied to an annotation always are
+     *
+     * @param diagnostic Diagnostic of the previous run
+     * @param stale IDs of the affected and removed annotations
+     * @return true if the diagnostic is outdated, false otherwise
+     */
+    static bool _is_stale(const Diagnostic &diagnostic,
+                          const std::unordered_set<std::string> &stale) {
+        if (diagnostic.id.empty() ||
+            stale.find(diagnostic.id) != stale.end()) {
+            return true;
+        }
+        for (const auto &id : diagnostic.related) {
+            if (stale.find(id) != stale.end()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Computes a 64-bit FNV-1a hash of every annotation, covering all
+     * of its fields. Annotations that share an ID get a common fingerprint
+     *
+     * @param annotations Annotations to fingerprint
+     * @return Hexadecimal fingerprints by ID
+     */
+    static std::unordered_map<std::string, std::string>
+    _fingerprint(const Annotations &annotations) {
+        std::unordered_map<std::string, uint64_t> hashes;
+        auto hash = [&hashes](const std::string &id,
+                              std::initializer_list<std::string> fields) {
+            auto [entry, inserted] = hashes.insert({id, 14695981039346656037u});
+            uint64_t &h = entry->second;
+            for (const auto &field : fields) {
+                for (unsigned char c : field) {
+                    h = (h ^ c) * 1099511628211u;
+                }
+                h = (h ^ 0xff) * 1099511628211u;
+            }
+        };
+
+        for (const auto &a : annotations.text_annotations) {
+            std::string references;
+            for (std::size_t i = 0; i < a.references.size(); i++) {
+                references += a.references[i] + ":";
+                if (i < a.reference_lines.size()) {
+                    references += std::to_string(a.reference_lines[i]);
+                }
+                references += ",";
+            }
+            hash(a.id, {"text", a.title, a.content, references, a.file});
+        }
+        for (const auto &a : annotations.code_annotations) {
+            hash(a.id, {"code", a.title, a.content, a.file,
+                        std::to_string(a.line)});
+        }
+
+        std::unordered_map<std::string, std::string> fingerprints;
+        char buffer[17];
+        for (const auto &[id, h] : hashes) {
+            std::snprintf(buffer, sizeof(buffer), "%016llx",
+                          static_cast<unsigned long long>(h));
+            fingerprints[id] = buffer;
+        }
+        return fingerprints;
+    }
+
+    bool _valid = false;
+    std::string _configuration;
+    std::unordered_map<std::string, std::string> _fingerprints;
+    std::vector<Diagnostic> _diagnostics;
+};
+
+} // namespace lect
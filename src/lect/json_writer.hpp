@@ -0,0 +1,296 @@
+/**
+ * @file json_writer.hpp
+ * @brief A streaming JSON writer that serializes values as they come, without
+ * building a document in memory first
+ */
+
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lect {
+
+/**
+ * @brief Builds a lookup table of characters that need to be escaped in JSON
+ * strings: quotes, backslashes and control characters
+ *
+ * @return Table indexed by the character
+ */
+constexpr std::array<bool, 256> _make_escape_table() {
+    std::array<bool, 256> table{};
+    for (int c = 0; c < 0x20; c++) {
+        table[c] = true;
+    }
+    table['"'] = true;
+    table['\\'] = true;
+    return table;
+}
+
+/**
+ * @brief Characters that need to be escaped in JSON strings
+ */
+constexpr std::array<bool, 256> escape_table = _make_escape_table();
+
+//$json-writer-src JSON writer
+/**
+ * @class JsonWriter
+ * @brief A SAX-style JSON writer. Values are appended to a buffer, which is
+ * flushed to the output stream whenever it grows past a threshold, so memory
+ * use doesn't depend on the size of the output. Without a stream the buffer
+ * keeps the whole output. Objects and arrays are written in the order of the
+ * calls, and commas and colons are inserted automatically. Strings are
+ * escaped the same way nlohmann::json::dump() escapes them
+ *
+ */
+struct JsonWriter {
+    /**
+     * @brief A constructor
+     *
+     * @param out Stream to write to, or nullptr to keep the output in the
+     * buffer
+     */
+    explicit JsonWriter(std::ostream *out = nullptr) : _out(out) {}
+
+    /**
+     * @brief Destructor, flushes the rest of the buffer
+     */
+    ~JsonWriter() { flush(); }
+
+    JsonWriter(const JsonWriter &) = delete;
+    JsonWriter &operator=(const JsonWriter &) = delete;
+
+    /**
+     * @brief Starts an object
+     *
+     * @param size Number of members. JSON doesn't need it, but binary formats
+     * do, so it's accepted to let the same code serialize to any of them
+     * @return The reference to the writer
+     */
+    JsonWriter &begin_object(std::size_t size = 0) {
+        _value();
+        _buffer += '{';
+        _first.push_back(true);
+        return *this;
+    }
+
+    /**
+     * @brief Ends the current object
+     *
+     * @return The reference to the writer
+     */
+    JsonWriter &end_object() {
+        _buffer += '}';
+        _first.pop_back();
+        return _flush_if_full();
+    }
+
+    /**
+     * @brief Starts an array
+     *
+     * @param size Number of elements, see begin_object()
+     * @return The reference to the writer
+     */
+    JsonWriter &begin_array(std::size_t size = 0) {
+        _value();
+        _buffer += '[';
+        _first.push_back(true);
+        return *this;
+    }
+
+    /**
+     * @brief Ends the current array
+     *
+     * @return The reference to the writer
+     */
+    JsonWriter &end_array() {
+        _buffer += ']';
+        _first.pop_back();
+        return _flush_if_full();
+    }
+
+    /**
+     * @brief Starts a fragment: values separated by commas, without brackets.
+     * Used to serialize a part of an array on its own and to insert it into
+     * the array later with raw()
+     *
+     * @return The reference to the writer
+     */
+    JsonWriter &begin_fragment() {
+        _first.push_back(true);
+        return *this;
+    }
+
+    /**
+     * @brief Ends the current fragment
+     *
+     * @return The reference to the writer
+     */
+    JsonWriter &end_fragment() {
+        _first.pop_back();
+        return *this;
+    }
+
+    /**
+     * @brief Writes the key of the next value in an object
+     *
+     * @param key Key
+     * @return The reference to the writer
+     */
+    JsonWriter &key(std::string_view key) {
+        _value();
+        _escape(key);
+        _buffer += ':';
+        _after_key = true;
+        return *this;
+    }
+
+    /**
+     * @brief Writes a string value
+     *
+     * @param string String
+     * @return The reference to the writer
+     */
+    JsonWriter &string(std::string_view string) {
+        _value();
+        _escape(string);
+        return _flush_if_full();
+    }
+
+    /**
+     * @brief Writes an integer value
+     *
+     * @param number Integer
+     * @return The reference to the writer
+     */
+    JsonWriter &number(int64_t number) {
+        _value();
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), number);
+        _buffer.append(digits, result.ptr);
+        return _flush_if_full();
+    }
+
+    /**
+     * @brief Writes an already serialized value as it is
+     *
+     * @param json Serialized JSON value
+     * @return The reference to the writer
+     */
+    JsonWriter &raw(std::string_view json) {
+        _value();
+        _buffer += json;
+        return _flush_if_full();
+    }
+
+    /**
+     * @brief Writes the buffer out to the stream, if there is one
+     */
+    void flush() {
+        if (_out != nullptr && !_buffer.empty()) {
+            _out->write(_buffer.data(), _buffer.size());
+            _buffer.clear();
+        }
+    }
+
+    /**
+     * @brief The output that hasn't been flushed yet
+     *
+     * @return Buffer
+     */
+    std::string &buffer() { return _buffer; }
+
+  private:
+    static constexpr std::size_t flush_threshold = 1 << 16;
+
+    std::ostream *_out;
+    std::string _buffer;
+    std::vector<bool> _first;
+    bool _after_key = false;
+
+    /**
+     * @brief Inserts a comma before a value if it isn't the first one in its
+     * object or array
+     */
+    void _value() {
+        if (_after_key) {
+            _after_key = false;
+            return;
+        }
+        if (_first.empty()) {
+            return;
+        }
+        if (!_first.back()) {
+            _buffer += ',';
+        }
+        _first.back() = false;
+    }
+
+    /**
+     * @brief Flushes the buffer once it grows past the threshold
+     *
+     * @return The reference to the writer
+     */
+    JsonWriter &_flush_if_full() {
+        if (_buffer.size() >= flush_threshold) {
+            flush();
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Appends a quoted and escaped string. Runs of characters that
+     * don't need escaping are copied at once
+     *
+     * @param string String to append
+     */
+    void _escape(std::string_view string) {
+        static const char hex[] = "0123456789abcdef";
+        _buffer += '"';
+        std::size_t run = 0;
+        for (std::size_t i = 0; i < string.size(); i++) {
+            unsigned char c = string[i];
+            if (!escape_table[c]) {
+                continue;
+            }
+            _buffer.append(string.data() + run, i - run);
+            run = i + 1;
+            switch (c) {
+            case '"':
+                _buffer += "\\\"";
+                break;
+            case '\\':
+                _buffer += "\\\\";
+                break;
+            case '\b':
+                _buffer += "\\b";
+                break;
+            case '\f':
+                _buffer += "\\f";
+                break;
+            case '\n':
+                _buffer += "\\n";
+                break;
+            case '\r':
+                _buffer += "\\r";
+                break;
+            case '\t':
+                _buffer += "\\t";
+                break;
+            default:
+                _buffer += "\\u00";
+                _buffer += hex[c >> 4];
+                _buffer += hex[c & 0xf];
+            }
+        }
+        _buffer.append(string.data() + run, string.size() - run);
+        _buffer += '"';
+    }
+};
+
+} // namespace lect
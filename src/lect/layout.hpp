@@ -0,0 +1,479 @@
+/**
+ * @file layout.hpp
+ * @brief A layered layout of the reference graph, computed at export time so
+ * that the viewer only has to draw it
+ */
+
+#pragma once
+
+#include "graph.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lect {
+
+//$layout-src Layered layout
+/**
+ * @class Layout
+ * @brief Positions of the nodes of the reference graph in a layered drawing.
+ * Every annotation is put on a layer below the annotations that reference it,
+ * the order of the nodes in the layers is chosen to reduce the crossings of
+ * the edges, and the nodes are then moved towards their neighbours without
+ * overlapping. Connected components are laid out on their own and placed
+ * next to each other. Node indices are the ones of the AnnotationGraph
+ *
+ */
+struct Layout {
+    std::vector<int32_t> x;
+    std::vector<int32_t> y;
+
+    /**
+     * @brief Computes the layout of a graph
+     *
+     * @param offsets Offsets of the edges of every node in targets
+     * @param targets Targets of the edges
+     * @param direction Direction of the drawing: "UD", "DU", "LR" or "RL"
+     * @param lineup Which nodes are lined up: "roots" or "leaves"
+     * @return The layout
+     */
+    static Layout compute(const std::vector<uint32_t> &offsets,
+                          const std::vector<uint32_t> &targets,
+                          const std::string &direction,
+                          const std::string &lineup) {
+        uint32_t count = offsets.empty() ? 0 : offsets.size() - 1;
+        bool vertical = direction == "UD" || direction == "DU";
+        double node_spacing = vertical ? 200 : 130;
+        double level_separation = vertical ? 120 : 200;
+
+        // Edges that go against a depth-first order close a cycle and are
+        // left out of the layering
+        std::vector<uint32_t> rank = _depth_first_rank(offsets, targets);
+        std::vector<std::vector<uint32_t>> children(count);
+        std::vector<uint32_t> parent(count);
+        std::iota(parent.begin(), parent.end(), 0);
+        for (uint32_t node = 0; node < count; node++) {
+            for (uint32_t i = offsets[node]; i < offsets[node + 1]; i++) {
+                if (rank[node] < rank[targets[i]]) {
+                    children[node].push_back(targets[i]);
+                    parent[_find(parent, node)] = _find(parent, targets[i]);
+                }
+            }
+        }
+
+        std::vector<uint32_t> by_rank(count);
+        for (uint32_t node = 0; node < count; node++) {
+            by_rank[rank[node]] = node;
+        }
+        std::vector<uint32_t> level(count, 0);
+        if (lineup == "leaves") {
+            std::vector<uint32_t> height(count, 0);
+            std::vector<uint32_t> component_height(count, 0);
+            for (auto it = by_rank.rbegin(); it != by_rank.rend(); it++) {
+                for (uint32_t child : children[*it]) {
+                    height[*it] = std::max(height[*it], height[child] + 1);
+                }
+                uint32_t &max = component_height[_find(parent, *it)];
+                max = std::max(max, height[*it]);
+            }
+            for (uint32_t node = 0; node < count; node++) {
+                level[node] =
+                    component_height[_find(parent, node)] - height[node];
+            }
+        } else {
+            for (uint32_t node : by_rank) {
+                for (uint32_t child : children[node]) {
+                    level[child] = std::max(level[child], level[node] + 1);
+                }
+            }
+        }
+
+        // Components, each in depth-first order, ordered by their first node
+        std::vector<std::vector<uint32_t>> components;
+        std::vector<uint32_t> component_of(count, UINT32_MAX);
+        for (uint32_t node : by_rank) {
+            uint32_t root = _find(parent, node);
+            if (component_of[root] == UINT32_MAX) {
+                component_of[root] = components.size();
+                components.emplace_back();
+            }
+            components[component_of[root]].push_back(node);
+        }
+
+        Layout layout;
+        layout.x.assign(count, 0);
+        layout.y.assign(count, 0);
+        std::vector<double> position(count, 0);
+        std::vector<uint32_t> local(count, 0);
+        double offset = 0;
+        for (const auto &component : components) {
+            double width = _place(component, children, level, node_spacing,
+                                  local, position);
+            for (uint32_t node : component) {
+                double along = std::round(offset + position[node]);
+                double across = level[node] * level_separation;
+                if (direction == "DU" || direction == "RL") {
+                    across = -across;
+                }
+                layout.x[node] = vertical ? along : across;
+                layout.y[node] = vertical ? across : along;
+            }
+            offset += width + tree_spacing;
+        }
+        return layout;
+    }
+
+  private:
+    static constexpr double tree_spacing = 300;
+    static constexpr int ordering_sweeps = 24;
+    static constexpr int stale_sweeps = 4;
+    static constexpr int placement_rounds = 8;
+
+    /**
+     * @class _Adjacency
+     * @brief Neighbours of the nodes of a layered component, stored like the
+     * edges of the AnnotationGraph in a single array that the sweeps run
+     * through without chasing a list per node
+     *
+     */
+    struct _Adjacency {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> targets;
+
+        /**
+         * @brief Builds the neighbours from a list of edges
+         *
+         * @param count Number of nodes
+         * @param edges Edges as pairs of the upper and the lower node
+         * @param upward Whether to store the upper nodes of the edges for
+         * their lower nodes, instead of the other way around
+         */
+        _Adjacency(uint32_t count,
+                   const std::vector<std::pair<uint32_t, uint32_t>> &edges,
+                   bool upward)
+            : offsets(count + 1, 0), targets(edges.size()) {
+            for (const auto &edge : edges) {
+                offsets[(upward ? edge.second : edge.first) + 1]++;
+            }
+            std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+            std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+            for (const auto &edge : edges) {
+                uint32_t from = upward ? edge.second : edge.first;
+                targets[next[from]++] = upward ? edge.first : edge.second;
+            }
+        }
+
+        AnnotationGraph::Range operator[](uint32_t node) const {
+            return {targets.data() + offsets[node],
+                    targets.data() + offsets[node + 1]};
+        }
+    };
+
+    /**
+     * @brief Finds the representative of a node in a union-find forest,
+     * halving the path on the way
+     *
+     * @param parent Parents of the nodes in the forest
+     * @param node Node to find
+     * @return Representative of the set of the node
+     */
+    static uint32_t _find(std::vector<uint32_t> &parent, uint32_t node) {
+        while (parent[node] != node) {
+            parent[node] = parent[parent[node]];
+            node = parent[node];
+        }
+        return node;
+    }
+
+    /**
+     * @brief Ranks the nodes in reverse postorder of a depth-first search
+     * that starts from the nodes nothing references. Every edge that doesn't
+     * close a cycle goes from a lower rank to a higher one
+     *
+     * @param offsets Offsets of the edges of every node in targets
+     * @param targets Targets of the edges
+     * @return Rank of every node
+     */
+    static std::vector<uint32_t>
+    _depth_first_rank(const std::vector<uint32_t> &offsets,
+                      const std::vector<uint32_t> &targets) {
+        uint32_t count = offsets.empty() ? 0 : offsets.size() - 1;
+        std::vector<uint32_t> in_degree(count, 0);
+        for (uint32_t target : targets) {
+            in_degree[target]++;
+        }
+        std::vector<uint32_t> starts;
+        for (uint32_t node = 0; node < count; node++) {
+            if (in_degree[node] == 0) {
+                starts.push_back(node);
+            }
+        }
+        for (uint32_t node = 0; node < count; node++) {
+            if (in_degree[node] != 0) {
+                starts.push_back(node);
+            }
+        }
+
+        std::vector<bool> visited(count, false);
+        std::vector<uint32_t> postorder;
+        postorder.reserve(count);
+        std::vector<std::pair<uint32_t, uint32_t>> stack;
+        for (uint32_t start : starts) {
+            if (visited[start]) {
+                continue;
+            }
+            visited[start] = true;
+            stack.push_back({start, offsets[start]});
+            while (!stack.empty()) {
+                uint32_t node = stack.back().first;
+                uint32_t &edge = stack.back().second;
+                if (edge == offsets[node + 1]) {
+                    postorder.push_back(node);
+                    stack.pop_back();
+                    continue;
+                }
+                uint32_t target = targets[edge++];
+                if (!visited[target]) {
+                    visited[target] = true;
+                    stack.push_back({target, offsets[target]});
+                }
+            }
+        }
+
+        std::vector<uint32_t> rank(count);
+        for (uint32_t i = 0; i < count; i++) {
+            rank[postorder[i]] = count - 1 - i;
+        }
+        return rank;
+    }
+
+    /**
+     * @brief Counts the crossings of the edges between two neighbouring
+     * layers, as the inversions of the lower ends of the edges ordered by
+     * their upper ends
+     *
+     * @param upper Nodes of the upper layer in order
+     * @param down Neighbours of every node in the layer below
+     * @param position Position of every node in its layer
+     * @param lower_size Number of nodes in the lower layer
+     * @param tree Scratch space for the Fenwick tree
+     * @param ends Scratch space for the lower ends of the edges of a node
+     * @return Number of crossings
+     */
+    static uint64_t _crossings(const std::vector<uint32_t> &upper,
+                               const _Adjacency &down,
+                               const std::vector<uint32_t> &position,
+                               std::size_t lower_size,
+                               std::vector<uint32_t> &tree,
+                               std::vector<uint32_t> &ends) {
+        tree.assign(lower_size + 1, 0);
+        uint64_t crossings = 0;
+        uint64_t inserted = 0;
+        for (uint32_t node : upper) {
+            ends.clear();
+            for (uint32_t child : down[node]) {
+                ends.push_back(position[child]);
+            }
+            std::sort(ends.begin(), ends.end());
+            for (uint32_t end : ends) {
+                uint64_t not_greater = 0;
+                for (uint32_t i = end + 1; i > 0; i -= i & -i) {
+                    not_greater += tree[i];
+                }
+                crossings += inserted - not_greater;
+                for (uint32_t i = end + 1; i <= lower_size; i += i & -i) {
+                    tree[i]++;
+                }
+                inserted++;
+            }
+        }
+        return crossings;
+    }
+
+    /**
+     * @brief Lays out a connected component. Edges that span several layers
+     * are split by dummy nodes, the layers are reordered by the barycenters of
+     * the neighbours in alternating sweeps, keeping the order with the fewest
+     * crossings until a few sweeps in a row don't reduce them, and the
+     * positions are then moved towards the neighbours in alternating rounds,
+     * packed from the left and from the right and averaged, which keeps the
+     * spacing
+     *
+     * @param component Nodes of the component in depth-first order
+     * @param children Children of every node
+     * @param level Layer of every node
+     * @param node_spacing Distance between nodes in a layer
+     * @param local Scratch space for the local indices of the nodes
+     * @param position Receives the positions of the nodes along the layers,
+     * starting at 0
+     * @return Width of the component
+     */
+    static double _place(const std::vector<uint32_t> &component,
+                         const std::vector<std::vector<uint32_t>> &children,
+                         const std::vector<uint32_t> &level,
+                         double node_spacing, std::vector<uint32_t> &local,
+                         std::vector<double> &position) {
+        uint32_t layer_count = 0;
+        for (uint32_t node : component) {
+            layer_count = std::max(layer_count, level[node] + 1);
+        }
+
+        // Local nodes are the nodes of the component followed by the dummies
+        std::vector<std::vector<uint32_t>> layers(layer_count);
+        std::vector<std::pair<uint32_t, uint32_t>> edges;
+        uint32_t local_count = 0;
+        for (uint32_t node : component) {
+            local[node] = local_count++;
+            layers[level[node]].push_back(local[node]);
+        }
+        for (uint32_t node : component) {
+            for (uint32_t child : children[node]) {
+                uint32_t from = local[node];
+                for (uint32_t l = level[node] + 1; l < level[child]; l++) {
+                    uint32_t dummy = local_count++;
+                    layers[l].push_back(dummy);
+                    edges.emplace_back(from, dummy);
+                    from = dummy;
+                }
+                edges.emplace_back(from, local[child]);
+            }
+        }
+        _Adjacency down(local_count, edges, false);
+        _Adjacency up(local_count, edges, true);
+
+        std::vector<uint32_t> order(local_count);
+        auto number = [&layers, &order]() {
+            for (const auto &layer : layers) {
+                for (uint32_t i = 0; i < layer.size(); i++) {
+                    order[layer[i]] = i;
+                }
+            }
+        };
+        std::vector<uint32_t> tree;
+        std::vector<uint32_t> ends;
+        auto total_crossings = [&]() {
+            uint64_t total = 0;
+            for (uint32_t l = 0; l + 1 < layer_count; l++) {
+                total += _crossings(layers[l], down, order,
+                                    layers[l + 1].size(), tree, ends);
+            }
+            return total;
+        };
+        number();
+        auto best = layers;
+        uint64_t best_crossings = total_crossings();
+        std::vector<double> barycenter(local_count);
+        int since_best = 0;
+        for (int sweep = 0; sweep < ordering_sweeps && best_crossings > 0 &&
+                            since_best < stale_sweeps;
+             sweep++) {
+            bool downward = sweep % 2 == 0;
+            const auto &neighbours = downward ? up : down;
+            for (uint32_t i = 1; i < layer_count; i++) {
+                auto &layer = layers[downward ? i : layer_count - 1 - i];
+                for (uint32_t node : layer) {
+                    if (neighbours[node].size() == 0) {
+                        barycenter[node] = order[node];
+                        continue;
+                    }
+                    double sum = 0;
+                    for (uint32_t neighbour : neighbours[node]) {
+                        sum += order[neighbour];
+                    }
+                    barycenter[node] = sum / neighbours[node].size();
+                }
+                std::stable_sort(layer.begin(), layer.end(),
+                                 [&barycenter](uint32_t a, uint32_t b) {
+                                     return barycenter[a] < barycenter[b];
+                                 });
+                for (uint32_t j = 0; j < layer.size(); j++) {
+                    order[layer[j]] = j;
+                }
+            }
+            uint64_t crossings = total_crossings();
+            since_best++;
+            if (crossings < best_crossings) {
+                best_crossings = crossings;
+                best = layers;
+                since_best = 0;
+            }
+        }
+        layers = std::move(best);
+        number();
+
+        // Dummies take less room than the boxes of the annotations
+        auto width = [&component, node_spacing](uint32_t node) {
+            return node < component.size() ? node_spacing : node_spacing / 4;
+        };
+        std::vector<double> x(local_count);
+        for (const auto &layer : layers) {
+            double at = 0;
+            for (uint32_t i = 0; i < layer.size(); i++) {
+                if (i > 0) {
+                    at += (width(layer[i - 1]) + width(layer[i])) / 2;
+                }
+                x[layer[i]] = at;
+            }
+        }
+        std::vector<double> wanted;
+        std::vector<double> left;
+        for (int round = 0; round < placement_rounds * 2; round++) {
+            bool downward = round % 2 == 0;
+            bool both = round >= placement_rounds;
+            for (uint32_t i = 0; i < layer_count; i++) {
+                const auto &layer = layers[downward ? i : layer_count - 1 - i];
+                wanted.assign(layer.size(), 0);
+                for (uint32_t j = 0; j < layer.size(); j++) {
+                    double sum = 0;
+                    std::size_t neighbours = 0;
+                    if (downward || both) {
+                        for (uint32_t neighbour : up[layer[j]]) {
+                            sum += x[neighbour];
+                        }
+                        neighbours += up[layer[j]].size();
+                    }
+                    if (!downward || both) {
+                        for (uint32_t neighbour : down[layer[j]]) {
+                            sum += x[neighbour];
+                        }
+                        neighbours += down[layer[j]].size();
+                    }
+                    wanted[j] =
+                        neighbours == 0 ? x[layer[j]] : sum / neighbours;
+                }
+                left = wanted;
+                for (uint32_t j = 1; j < layer.size(); j++) {
+                    double gap = (width(layer[j - 1]) + width(layer[j])) / 2;
+                    left[j] = std::max(left[j], left[j - 1] + gap);
+                }
+                for (uint32_t j = layer.size(); j-- > 0;) {
+                    if (j + 1 < layer.size()) {
+                        double gap =
+                            (width(layer[j]) + width(layer[j + 1])) / 2;
+                        wanted[j] = std::min(wanted[j], wanted[j + 1] - gap);
+                    }
+                }
+                for (uint32_t j = 0; j < layer.size(); j++) {
+                    x[layer[j]] = (left[j] + wanted[j]) / 2;
+                }
+            }
+        }
+
+        double min = INFINITY;
+        double max = -INFINITY;
+        for (uint32_t node : component) {
+            min = std::min(min, x[local[node]]);
+            max = std::max(max, x[local[node]]);
+        }
+        for (uint32_t node : component) {
+            position[node] = x[local[node]] - min;
+        }
+        return max - min;
+    }
+};
+
+} // namespace lect
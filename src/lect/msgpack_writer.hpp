@@ -0,0 +1,247 @@
+/**
+ * @file msgpack_writer.hpp
+ * @brief A streaming MessagePack writer with the same interface as the JSON
+ * writer
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace lect {
+
+//$msgpack-writer-src MessagePack writer
+/**
+ * @class MessagePackWriter
+ * @brief A SAX-style MessagePack writer. It has the same interface as
+ * JsonWriter, so the same serialization code works for both, but the sizes of
+ * objects and arrays have to be known when they are started. Values are
+ * appended to a buffer that is flushed to the output stream whenever it grows
+ * past a threshold. Integers and strings use their shortest encoding
+ *
+ */
+struct MessagePackWriter {
+    /**
+     * @brief A constructor
+     *
+     * @param out Stream to write to, or nullptr to keep the output in the
+     * buffer
+     */
+    explicit MessagePackWriter(std::ostream *out = nullptr) : _out(out) {}
+
+    /**
+     * @brief Destructor, flushes the rest of the buffer
+     */
+    ~MessagePackWriter() { flush(); }
+
+    MessagePackWriter(const MessagePackWriter &) = delete;
+    MessagePackWriter &operator=(const MessagePackWriter &) = delete;
+
+    /**
+     * @brief Starts a map
+     *
+     * @param size Number of members
+     * @return The reference to the writer
+     */
+    MessagePackWriter &begin_object(std::size_t size) {
+        _header(size, 0x80, 0xde, 0xdf);
+        return *this;
+    }
+
+    /**
+     * @brief Ends the current map. Nothing needs to be written
+     *
+     * @return The reference to the writer
+     */
+    MessagePackWriter &end_object() { return _flush_if_full(); }
+
+    /**
+     * @brief Starts an array
+     *
+     * @param size Number of elements
+     * @return The reference to the writer
+     */
+    MessagePackWriter &begin_array(std::size_t size) {
+        _header(size, 0x90, 0xdc, 0xdd);
+        return *this;
+    }
+
+    /**
+     * @brief Ends the current array. Nothing needs to be written
+     *
+     * @return The reference to the writer
+     */
+    MessagePackWriter &end_array() { return _flush_if_full(); }
+
+    /**
+     * @brief Starts a fragment of array elements that is serialized on its
+     * own. Nothing needs to be written
+     *
+     * @return The reference to the writer
+     */
+    MessagePackWriter &begin_fragment() { return *this; }
+
+    /**
+     * @brief Ends the current fragment
+     *
+     * @return The reference to the writer
+     */
+    MessagePackWriter &end_fragment() { return *this; }
+
+    /**
+     * @brief Writes the key of the next value in a map
+     *
+     * @param key Key
+     * @return The reference to the writer
+     */
+    MessagePackWriter &key(std::string_view key) { return string(key); }
+
+    /**
+     * @brief Writes a string value
+     *
+     * @param string String
+     * @return The reference to the writer
+     */
+    MessagePackWriter &string(std::string_view string) {
+        if (string.size() < 32) {
+            _buffer += static_cast<char>(0xa0 | string.size());
+        } else if (string.size() <= UINT8_MAX) {
+            _buffer += static_cast<char>(0xd9);
+            _big_endian(string.size(), 1);
+        } else if (string.size() <= UINT16_MAX) {
+            _buffer += static_cast<char>(0xda);
+            _big_endian(string.size(), 2);
+        } else {
+            _buffer += static_cast<char>(0xdb);
+            _big_endian(string.size(), 4);
+        }
+        _buffer += string;
+        return _flush_if_full();
+    }
+
+    /**
+     * @brief Writes an integer value
+     *
+     * @param number Integer
+     * @return The reference to the writer
+     */
+    MessagePackWriter &number(int64_t number) {
+        if (number >= 0) {
+            uint64_t value = number;
+            if (value < 128) {
+                _buffer += static_cast<char>(value);
+            } else if (value <= UINT8_MAX) {
+                _buffer += static_cast<char>(0xcc);
+                _big_endian(value, 1);
+            } else if (value <= UINT16_MAX) {
+                _buffer += static_cast<char>(0xcd);
+                _big_endian(value, 2);
+            } else if (value <= UINT32_MAX) {
+                _buffer += static_cast<char>(0xce);
+                _big_endian(value, 4);
+            } else {
+                _buffer += static_cast<char>(0xcf);
+                _big_endian(value, 8);
+            }
+        } else if (number >= -32) {
+            _buffer += static_cast<char>(number);
+        } else if (number >= INT8_MIN) {
+            _buffer += static_cast<char>(0xd0);
+            _big_endian(number, 1);
+        } else if (number >= INT16_MIN) {
+            _buffer += static_cast<char>(0xd1);
+            _big_endian(number, 2);
+        } else if (number >= INT32_MIN) {
+            _buffer += static_cast<char>(0xd2);
+            _big_endian(number, 4);
+        } else {
+            _buffer += static_cast<char>(0xd3);
+            _big_endian(number, 8);
+        }
+        return _flush_if_full();
+    }
+
+    /**
+     * @brief Writes already encoded values as they are
+     *
+     * @param bytes Encoded values
+     * @return The reference to the writer
+     */
+    MessagePackWriter &raw(std::string_view bytes) {
+        _buffer += bytes;
+        return _flush_if_full();
+    }
+
+    /**
+     * @brief Writes the buffer out to the stream, if there is one
+     */
+    void flush() {
+        if (_out != nullptr && !_buffer.empty()) {
+            _out->write(_buffer.data(), _buffer.size());
+            _buffer.clear();
+        }
+    }
+
+    /**
+     * @brief The output that hasn't been flushed yet
+     *
+     * @return Buffer
+     */
+    std::string &buffer() { return _buffer; }
+
+  private:
+    static constexpr std::size_t flush_threshold = 1 << 16;
+
+    std::ostream *_out;
+    std::string _buffer;
+
+    /**
+     * @brief Appends the lowest bytes of a value, most significant first
+     *
+     * @param value Value to append
+     * @param bytes Number of bytes
+     */
+    void _big_endian(uint64_t value, int bytes) {
+        for (int i = bytes - 1; i >= 0; i--) {
+            _buffer += static_cast<char>((value >> (i * 8)) & 0xff);
+        }
+    }
+
+    /**
+     * @brief Appends the header of a map or an array
+     *
+     * @param size Number of members or elements
+     * @param fixed Type byte of the short form, ored with the size
+     * @param short_type Type byte with a 16-bit size
+     * @param long_type Type byte with a 32-bit size
+     */
+    void _header(std::size_t size, unsigned char fixed,
+                 unsigned char short_type, unsigned char long_type) {
+        if (size < 16) {
+            _buffer += static_cast<char>(fixed | size);
+        } else if (size <= UINT16_MAX) {
+            _buffer += static_cast<char>(short_type);
+            _big_endian(size, 2);
+        } else {
+            _buffer += static_cast<char>(long_type);
+            _big_endian(size, 4);
+        }
+    }
+
+    /**
+     * @brief Flushes the buffer once it grows past the threshold
+     *
+     * @return The reference to the writer
+     */
+    MessagePackWriter &_flush_if_full() {
+        if (_buffer.size() >= flush_threshold) {
+            flush();
+        }
+        return *this;
+    }
+};
+
+} // namespace lect
@@ -1,46 +1,214 @@
 #pragma once
 
-#include "nlohmann/json.hpp"
-#include "nlohmann/json_fwd.hpp"
+#include "graph.hpp"
+#include "groups.hpp"
+#include "layout.hpp"
 #include "structures.hpp"
 #include <cstdint>
-#include <functional>
-#include <iostream>
-#include <set>
+#include <optional>
 #include <string>
-#include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace lect {
 
+//$payload-src Payload class
+/**
+ * @class Payload
+ * @brief Everything the documentation frontend needs: the annotations, the
+ * reference graph and the display options. Instead of listing the connected
+ * annotations of every annotation, which grows quadratically, the references
+ * are stored once as a compressed sparse row graph over node indices, from
+ * which the viewer finds the connected annotations when it needs them. Node
+ * indices count the text annotations first, followed by the code annotations.
+ * The positions of the nodes are computed in advance, so the viewer doesn't
+ * have to lay the graph out, and so are the groups it collapses large graphs
+ * into
+ *
+ */
+struct Payload {
+    Annotations annotations;
+    std::vector<uint32_t> graph_offsets;
+    std::vector<uint32_t> graph_targets;
+    std::optional<std::string> direction;
+    std::optional<std::string> lineup;
+    std::optional<Layout> layout;
+    std::optional<Groups> groups;
+};
+
+/**
+ * @class DirectionStage
+ * @brief A stage that sets the direction of the tree
+ *
+ */
+struct DirectionStage {
+    std::string direction;
+
+    void operator()(Payload &payload) const { payload.direction = direction; }
+};
+
+/**
+ * @class LineupStage
+ * @brief A stage that sets which nodes are lined up
+ *
+ */
+struct LineupStage {
+    std::string lineup;
+
+    void operator()(Payload &payload) const { payload.lineup = lineup; }
+};
+
+/**
+ * @class LayoutStage
+ * @brief A stage that lays the graph out in the direction and with the lineup
+ * set by the previous stages
+ *
+ */
+struct LayoutStage {
+    void operator()(Payload &payload) const {
+        payload.layout = Layout::compute(
+            payload.graph_offsets, payload.graph_targets,
+            payload.direction.value_or("UD"), payload.lineup.value_or("roots"));
+    }
+};
+
+/**
+ * @class GroupStage
+ * @brief A stage that groups the nodes for the viewer to collapse
+ *
+ */
+struct GroupStage {
+    void operator()(Payload &payload) const {
+        payload.groups = Groups::compute(
+            payload.annotations, payload.graph_offsets, payload.graph_targets);
+    }
+};
+
+/**
+ * @class RemoveCodeMiddleStage
+ * @brief A stage that replaces all but the first and the last line of code
+ * annotations with an ellipsis. The highlights follow the text they cover:
+ * the ones after the ellipsis are shifted and the ones in the removed lines
+ * are cut
+ *
+ */
+struct RemoveCodeMiddleStage {
+    void operator()(Annotations &annotations) const {
+        for (auto &annotation : annotations.code_annotations) {
+            uint64_t first_newline = annotation.content.find_first_of("\n");
+            uint64_t last_newline = annotation.content.find_last_of("\n");
+            if (first_newline == std::string::npos ||
+                last_newline == std::string::npos) {
+                continue;
+            }
+            if (first_newline == last_newline) {
+                _replace(annotation, first_newline + 1, 0, "  ...\n");
+                continue;
+            }
+            _replace(annotation, first_newline + 1,
+                     last_newline - first_newline - 1, "  ...");
+        }
+    }
+
+  private:
+    /**
+     * @brief Replaces a part of the content of a code annotation and moves
+     * its highlights along. Highlights that overlap the replaced part keep
+     * what remains of them on either side
+     *
+     * @param annotation Code annotation to modify
+     * @param position Start of the replaced part
+     * @param length Length of the replaced part
+     * @param replacement Text that replaces it
+     */
+    static void _replace(CodeAnnotation &annotation, uint32_t position,
+                         uint32_t length, const std::string &replacement) {
+        annotation.content.replace(position, length, replacement);
+        uint32_t end = position + length;
+        uint32_t size = replacement.size();
+        std::vector<Highlight> highlights;
+        highlights.reserve(annotation.highlights.size());
+        for (auto &highlight : annotation.highlights) {
+            if (highlight.end <= position) {
+                highlights.push_back(std::move(highlight));
+            } else if (highlight.start >= end) {
+                highlight.start = highlight.start - length + size;
+                highlight.end = highlight.end - length + size;
+                highlights.push_back(std::move(highlight));
+            } else {
+                if (highlight.start < position) {
+                    highlights.push_back(
+                        {highlight.start, position, highlight.kind});
+                }
+                if (highlight.end > end) {
+                    highlights.push_back({position + size,
+                                          highlight.end - length + size,
+                                          std::move(highlight.kind)});
+                }
+            }
+        }
+        annotation.highlights = std::move(highlights);
+    }
+};
+
+/**
+ * @brief A stage that modifies the annotations before they are converted
+ */
+using AnnotationsStage = std::variant<RemoveCodeMiddleStage>;
+
+/**
+ * @brief A stage that modifies the final payload
+ */
+using PayloadStage =
+    std::variant<DirectionStage, LineupStage, LayoutStage, GroupStage>;
+
 //$preprocessing-src Preprocessing class
 /**
  * @class Preprocessing
- * @brief Preprocessing class is a wrapper over the preprocessing function that
- * converts and modifies annotations into a JSON document
+ * @brief Preprocessing class is a pipeline of stages that converts and
+ * modifies annotations into a payload. Every stage works in place, so
+ * it doesn't cost more than its own modification
  *
  */
 struct Preprocessing {
     /**
-     * @brief A constructor that initializes the function
+     * @brief A constructor that initializes the stages
      *
-     * @param preprocess The preprocessing function
+     * @param annotations_stages Stages that modify the annotations
+     * @param payload_stages Stages that modify the payload
      */
-    Preprocessing(std::function<nlohmann::json(Annotations &)> preprocess)
-        : _preprocess(preprocess) {}
+    Preprocessing(std::vector<AnnotationsStage> annotations_stages,
+                  std::vector<PayloadStage> payload_stages)
+        : _annotations_stages(std::move(annotations_stages)),
+          _payload_stages(std::move(payload_stages)) {}
 
     /**
-     * @brief Call the stored preprocessing function
+     * @brief Run the stages. The annotations are moved into the payload
      *
      * @param annotations Annotations to preprocess
-     * @return Final JSON document
+     * @param graph Reference graph of the annotations
+     * @return Final payload
      */
-    nlohmann::json preprocess(Annotations &annotations) {
-        return _preprocess(annotations);
+    Payload preprocess(Annotations annotations,
+                       const AnnotationGraph &graph) const {
+        for (const auto &stage : _annotations_stages) {
+            std::visit([&annotations](const auto &s) { s(annotations); },
+                       stage);
+        }
+        Payload payload;
+        payload.annotations = std::move(annotations);
+        payload.graph_offsets = graph.offsets;
+        payload.graph_targets = graph.targets;
+        for (const auto &stage : _payload_stages) {
+            std::visit([&payload](const auto &s) { s(payload); }, stage);
+        }
+        return payload;
     }
 
   private:
-    std::function<nlohmann::json(Annotations &)> _preprocess;
+    std::vector<AnnotationsStage> _annotations_stages;
+    std::vector<PayloadStage> _payload_stages;
 };
 
 //$preprocessing-builder-src PreprocessingBuilder class
@@ -59,171 +227,48 @@ struct PrepocessingBuilder {
      * @return The reference to the builder
      */
     PrepocessingBuilder &add_direction(std::string direction) {
-        auto prev = _json_preprocessing;
-        _json_preprocessing = [prev, direction](nlohmann::json &dict) {
-            auto new_dict = prev(dict);
-            return _add_direction(new_dict, direction);
-        };
+        _payload_stages.push_back(DirectionStage{std::move(direction)});
         return *this;
     }
 
+    /**
+     * @brief Adds a step that sets which nodes are lined up
+     *
+     * @param lineup The lineup string, should be either "leaves" or "roots"
+     * @return The reference to the builder
+     */
     PrepocessingBuilder &set_lineup(std::string lineup) {
-        auto prev = _json_preprocessing;
-        _json_preprocessing = [prev, lineup](nlohmann::json &dict) {
-            auto new_dict = prev(dict);
-            return _set_lineup(new_dict, lineup);
-        };
+        _payload_stages.push_back(LineupStage{std::move(lineup)});
         return *this;
     }
 
+    /**
+     * @brief Adds a step that removes the middle lines of code annotations
+     *
+     * @return The reference to the builder
+     */
     PrepocessingBuilder &remove_code_annotations_middle() {
-        auto prev = _annotations_preprocessing;
-        _annotations_preprocessing = [prev](Annotations &annotations) {
-            _remove_code_annotations_middle(annotations);
-            prev(annotations);
-        };
+        _annotations_stages.push_back(RemoveCodeMiddleStage{});
         return *this;
     }
 
     /**
-     * @brief Resolves and builds the final preprocessing object
+     * @brief Resolves and builds the final preprocessing object. The stages
+     * are moved into it, which leaves the builder empty. The layout and
+     * grouping stages are always the last ones, because the layout depends on
+     * the direction and the lineup
      *
      * @return The final preprocessing object
      */
     Preprocessing build() {
-        auto json_preprocessing = _json_preprocessing;
-        auto annotations_preprocessing = _annotations_preprocessing;
-        std::function<nlohmann::json(Annotations &)> function =
-            [json_preprocessing,
-             annotations_preprocessing](Annotations &annotations) {
-                annotations_preprocessing(annotations);
-                auto dict = _annotations_to_json(annotations);
-                return json_preprocessing(dict);
-            };
-        return Preprocessing(function);
+        _payload_stages.push_back(LayoutStage{});
+        _payload_stages.push_back(GroupStage{});
+        return Preprocessing(std::move(_annotations_stages),
+                             std::move(_payload_stages));
     }
 
   private:
-    std::function<nlohmann::json(nlohmann::json &)> _json_preprocessing =
-        [](nlohmann::json &dict) { return dict; };
-
-    std::function<void(Annotations &)> _annotations_preprocessing =
-        [](Annotations &) {};
-
-    static nlohmann::json _annotations_to_json(const Annotations &annotations) {
-        using namespace nlohmann;
-
-        auto connections = _get_connected(annotations);
-
-        json dict = {{"text_annotations", json::array()},
-                     {"code_annotations", json::array()}};
-
-        for (const auto &a : annotations.text_annotations) {
-            json t = {{"id", a.id},
-                      {"title", a.title},
-                      {"content", a.content},
-                      {"connected_to", connections.at(a.id)},
-                      {"references",
-                       std::set(a.references.begin(), a.references.end())}};
-            dict["text_annotations"].push_back(t);
-        }
-
-        for (const auto &a : annotations.code_annotations) {
-            json t = {
-                {"id", a.id},           {"title", a.title},
-                {"content", a.content}, {"file", a.file},
-                {"line", a.line},       {"connected_to", connections.at(a.id)}};
-            dict["code_annotations"].push_back(t);
-        }
-
-        return dict;
-    }
-
-    /**
-     * @brief Gets a mapping between a node and a set of nodes connected to it
-     *
-     * @param annotations Annotations
-     * @return Map of nodes and sets of nodes connected to them
-     */
-    static std::unordered_map<std::string, std::set<std::string>>
-    _get_connected(const Annotations &annotations) {
-        std::unordered_map<std::string, std::set<std::string>> connections;
-        std::unordered_map<std::string, std::set<std::string>> references;
-        std::unordered_map<std::string, int> reference_count;
-        for (const auto &a : annotations.text_annotations) {
-            connections.insert({a.id, {}});
-            references.insert(
-                {a.id, std::set(a.references.begin(), a.references.end())});
-            reference_count.insert({a.id, 0});
-        }
-
-        for (const auto &a : annotations.code_annotations) {
-            connections.insert({a.id, {}});
-            references.insert({a.id, {}});
-            reference_count.insert({a.id, 0});
-        }
-
-        for (const auto &annotations_references : references) {
-            for (const auto &ref : annotations_references.second) {
-                reference_count.at(ref)++;
-            }
-        }
-        std::vector<std::string> roots;
-        for (const auto &[id, count] : reference_count) {
-            if (count == 0) {
-                roots.push_back(id);
-            }
-        }
-
-        for (const auto &root : roots) {
-            _get_connected_iter(root, connections, references, {});
-        }
-
-        return connections;
-    }
-
-    static void _get_connected_iter(
-        std::string node,
-        std::unordered_map<std::string, std::set<std::string>> &connections,
-        const std::unordered_map<std::string, std::set<std::string>>
-            &references,
-        std::set<std::string> prev) {
-
-        prev.insert(node);
-        for (auto &p : prev) {
-            std::set<std::string> &con = connections.at(p);
-            con.insert(prev.begin(), prev.end());
-        }
-        for (const auto &ref : references.at(node)) {
-            _get_connected_iter(ref, connections, references, prev);
-        }
-    }
-
-    static nlohmann::json _add_direction(nlohmann::json &dict,
-                                         const std::string &dir) {
-        dict["dir"] = dir;
-        return dict;
-    }
-
-    static nlohmann::json _set_lineup(nlohmann::json &dict,
-                                      const std::string &lineup) {
-        dict["shake"] = lineup;
-        return dict;
-    }
-
-    static void _remove_code_annotations_middle(Annotations &annotations) {
-        for (auto &annotation : annotations.code_annotations) {
-            uint64_t first_newline = annotation.content.find_first_of("\n");
-            uint64_t last_newline = annotation.content.find_last_of("\n");
-            if (first_newline == std::string::npos ||
-                last_newline == std::string::npos) {
-                continue;
-            }
-            annotation.content =
-                annotation.content.substr(0, first_newline + 1) + "  ..." +
-                annotation.content.substr(
-                    last_newline, annotation.content.size() - last_newline);
-        }
-    }
+    std::vector<AnnotationsStage> _annotations_stages;
+    std::vector<PayloadStage> _payload_stages;
 };
 } // namespace lect
@@ -0,0 +1,111 @@
+/**
+ * @file registry.hpp
+ * @brief A concurrent registry of annotation IDs, used to detect duplicate
+ * IDs while the annotations are still being extracted
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace lect {
+
+/**
+ * @class IdRegistry
+ * @brief A lock-free, insert-only hash set of annotation IDs and the places
+ * they were found at. It's a fixed array of buckets, each of which is a linked
+ * list that is only ever prepended to with compare-and-swap
+ *
+ */
+struct IdRegistry {
+    /**
+     * @class Location
+     * @brief The place where an annotation was found
+     *
+     */
+    struct Location {
+        std::string file;
+        int line;
+    };
+
+    /**
+     * @brief A constructor
+     */
+    IdRegistry()
+        : _buckets(std::make_unique<std::atomic<Node *>[]>(bucket_count)) {
+        for (std::size_t i = 0; i < bucket_count; i++) {
+            _buckets[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    IdRegistry(const IdRegistry &) = delete;
+    IdRegistry &operator=(const IdRegistry &) = delete;
+    IdRegistry(IdRegistry &&) = default;
+    IdRegistry &operator=(IdRegistry &&) = default;
+
+    /**
+     * @brief Destructor
+     */
+    ~IdRegistry() {
+        if (_buckets == nullptr) {
+            return;
+        }
+        for (std::size_t i = 0; i < bucket_count; i++) {
+            Node *node = _buckets[i].load(std::memory_order_relaxed);
+            while (node != nullptr) {
+                Node *next = node->next;
+                delete node;
+                node = next;
+            }
+        }
+    }
+
+    /**
+     * @brief Registers an ID. Safe to call from several threads at once
+     *
+     * @param id ID of the annotation
+     * @param location Where the annotation was found
+     * @return nullptr if the ID is new, otherwise the location at which it was
+     * registered first
+     */
+    const Location *insert(const std::string &id, Location location) {
+        std::size_t hash = std::hash<std::string>{}(id);
+        std::atomic<Node *> &bucket = _buckets[hash % bucket_count];
+        Node *node = new Node{hash, id, std::move(location), nullptr};
+
+        Node *head = bucket.load(std::memory_order_acquire);
+        Node *checked = nullptr;
+        while (true) {
+            for (Node *n = head; n != checked; n = n->next) {
+                if (n->hash == hash && n->id == id) {
+                    delete node;
+                    return &n->location;
+                }
+            }
+            checked = head;
+            node->next = head;
+            if (bucket.compare_exchange_weak(head, node,
+                                             std::memory_order_release,
+                                             std::memory_order_acquire)) {
+                return nullptr;
+            }
+        }
+    }
+
+  private:
+    struct Node {
+        std::size_t hash;
+        std::string id;
+        Location location;
+        Node *next;
+    };
+
+    static constexpr std::size_t bucket_count = 1 << 16;
+    std::unique_ptr<std::atomic<Node *>[]> _buckets;
+};
+
+} // namespace lect
@@ -0,0 +1,128 @@
+/**
+ * @file scan.hpp
+ * @brief Functions for finding annotation references and validating
+ * annotation IDs
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace lect {
+
+/**
+ * @brief Builds a lookup table of characters that are allowed in annotation
+ * IDs: latin letters and hyphens
+ *
+ * @return Table indexed by the character
+ */
+constexpr std::array<bool, 256> _make_id_table() {
+    std::array<bool, 256> table{};
+    for (int c = 'a'; c <= 'z'; c++) {
+        table[c] = true;
+    }
+    for (int c = 'A'; c <= 'Z'; c++) {
+        table[c] = true;
+    }
+    table['-'] = true;
+    return table;
+}
+
+/**
+ * @brief Characters that are allowed in annotation IDs
+ */
+constexpr std::array<bool, 256> id_table = _make_id_table();
+
+/**
+ * @brief Finds the first character at or after position that isn't allowed in
+ * an annotation ID
+ *
+ * @param string String to look in
+ * @param position Position to start at
+ * @return Position of the character, or the size of the string if there isn't
+ * one
+ */
+inline std::size_t find_id_end(std::string_view string, std::size_t position) {
+    while (position < string.size() &&
+           id_table[static_cast<unsigned char>(string[position])]) {
+        position++;
+    }
+    return position;
+}
+
+/**
+ * @brief Checks whether a string is a valid annotation ID, meaning it's not
+ * empty and consists only of latin letters and hyphens
+ *
+ * @param id ID to check
+ * @return true if it is valid, false otherwise
+ */
+inline bool is_valid_id(std::string_view id) {
+    return !id.empty() && find_id_end(id, 0) == id.size();
+}
+
+/**
+ * @brief Finds the next dollar sign at or after position. Compares 16 bytes at
+ * a time when SSE2 is available
+ *
+ * @param string String to look in
+ * @param position Position to start at
+ * @return Position of the dollar sign, or std::string_view::npos if there
+ * isn't one
+ */
+inline std::size_t find_dollar(std::string_view string, std::size_t position) {
+    const char *data = string.data();
+    std::size_t size = string.size();
+#if defined(__SSE2__)
+    const __m128i dollar = _mm_set1_epi8('$');
+    while (position + 16 <= size) {
+        __m128i chunk = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(data + position));
+        uint32_t mask =
+            _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, dollar));
+        if (mask != 0) {
+            return position + __builtin_ctz(mask);
+        }
+        position += 16;
+    }
+#endif
+    if (position >= size) {
+        return std::string_view::npos;
+    }
+    const void *found = std::memchr(data + position, '$', size - position);
+    if (found == nullptr) {
+        return std::string_view::npos;
+    }
+    return static_cast<const char *>(found) - data;
+}
+
+/**
+ * @brief Finds all references to other annotations in the content of a text
+ * annotation, without copying them. A reference is a dollar sign followed by
+ * an ID. A dollar sign that isn't followed by an ID is still reported, with an
+ * empty ID, so that the caller can treat it as an error
+ *
+ * @tparam F Function type
+ * @param content Content to look in
+ * @param emit Function that is called with the ID of each reference and the
+ * position of its dollar sign
+ */
+template <typename F>
+void scan_references(std::string_view content, F &&emit) {
+    std::size_t dollar = find_dollar(content, 0);
+    while (dollar != std::string_view::npos) {
+        std::size_t end = find_id_end(content, dollar + 1);
+        emit(content.substr(dollar + 1, end - dollar - 1), dollar);
+        dollar = find_dollar(content, end);
+    }
+}
+
+} // namespace lect
@@ -0,0 +1,181 @@
+/**
+ * @file search.hpp
+ * @brief A full-text search index of the annotations, which the viewer
+ * queries without scanning the annotations themselves
+ */
+
+#pragma once
+
+#include "json_writer.hpp"
+#include "structures.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lect {
+
+//$search-index-src Search index
+/**
+ * @class SearchIndex
+ * @brief An inverted index from the words of the IDs, titles and contents of
+ * the annotations to the nodes they appear in. Nodes are numbered like in the
+ * AnnotationGraph. The terms are sorted, so the viewer can find the ones that
+ * start with a query by binary search. The postings of each term are the
+ * increasing node numbers, stored as the differences between neighbours in
+ * LEB128 varints and concatenated into a single byte string
+ *
+ */
+struct SearchIndex {
+    std::vector<std::string> terms;
+    std::vector<uint32_t> offsets;
+    std::string postings;
+
+    /**
+     * @brief Builds the index out of the annotations
+     *
+     * @param annotations Annotations to index
+     * @return The index
+     */
+    static SearchIndex build(const Annotations &annotations) {
+        std::unordered_map<std::string, std::vector<uint32_t>> nodes;
+        uint32_t node = 0;
+        auto add = [&nodes, &node](std::string_view text) {
+            _tokenize(text, [&nodes, &node](std::string token) {
+                auto &list = nodes[std::move(token)];
+                if (list.empty() || list.back() != node) {
+                    list.push_back(node);
+                }
+            });
+        };
+        for (const auto &a : annotations.text_annotations) {
+            add(a.id);
+            add(a.title);
+            add(a.content);
+            node++;
+        }
+        for (const auto &a : annotations.code_annotations) {
+            add(a.id);
+            add(a.title);
+            add(a.content);
+            node++;
+        }
+
+        SearchIndex index;
+        index.terms.reserve(nodes.size());
+        for (const auto &entry : nodes) {
+            index.terms.push_back(entry.first);
+        }
+        std::sort(index.terms.begin(), index.terms.end());
+
+        index.offsets.reserve(index.terms.size() + 1);
+        index.offsets.push_back(0);
+        for (const auto &term : index.terms) {
+            uint32_t previous = 0;
+            for (uint32_t n : nodes[term]) {
+                _varint(index.postings, n - previous);
+                previous = n;
+            }
+            index.offsets.push_back(index.postings.size());
+        }
+        return index;
+    }
+
+    /**
+     * @brief Serializes the index as an object with the terms, the offsets of
+     * their postings and the base64 encoded postings
+     *
+     * @param writer Writer to serialize into
+     */
+    void write(JsonWriter &writer) const {
+        writer.begin_object();
+        writer.key("offsets").begin_array();
+        for (uint32_t offset : offsets) {
+            writer.number(offset);
+        }
+        writer.end_array();
+        writer.key("postings").string(_base64(postings));
+        writer.key("terms").begin_array();
+        for (const auto &term : terms) {
+            writer.string(term);
+        }
+        writer.end_array();
+        writer.end_object();
+    }
+
+  private:
+    static constexpr std::size_t max_token_size = 64;
+
+    /**
+     * @brief Splits text into lowercase terms. Terms are runs of ASCII
+     * letters and digits and of non-ASCII characters, so identifiers split at
+     * underscores and dashes. Overlong runs aren't indexed
+     *
+     * @param text Text to split
+     * @param emit Function called with every term
+     */
+    template <typename F> static void _tokenize(std::string_view text, F emit) {
+        std::string token;
+        for (std::size_t i = 0; i <= text.size(); i++) {
+            unsigned char c = i < text.size() ? text[i] : ' ';
+            bool word = (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                        c >= 0x80;
+            if (word) {
+                token += c;
+            } else if (c >= 'A' && c <= 'Z') {
+                token += static_cast<char>(c - 'A' + 'a');
+            } else if (!token.empty()) {
+                if (token.size() <= max_token_size) {
+                    emit(std::move(token));
+                }
+                token.clear();
+            }
+        }
+    }
+
+    /**
+     * @brief Appends an unsigned LEB128 varint: 7 bits per byte, least
+     * significant first, with the high bit set on all but the last byte
+     *
+     * @param out String to append to
+     * @param value Value to append
+     */
+    static void _varint(std::string &out, uint32_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    /**
+     * @brief Encodes bytes in base64
+     *
+     * @param bytes Bytes to encode
+     * @return Encoded string
+     */
+    static std::string _base64(std::string_view bytes) {
+        static const char alphabet[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string out;
+        out.reserve((bytes.size() + 2) / 3 * 4);
+        for (std::size_t i = 0; i < bytes.size(); i += 3) {
+            uint32_t group = static_cast<unsigned char>(bytes[i]) << 16;
+            if (i + 1 < bytes.size()) {
+                group |= static_cast<unsigned char>(bytes[i + 1]) << 8;
+            }
+            if (i + 2 < bytes.size()) {
+                group |= static_cast<unsigned char>(bytes[i + 2]);
+            }
+            out += alphabet[(group >> 18) & 0x3f];
+            out += alphabet[(group >> 12) & 0x3f];
+            out += i + 1 < bytes.size() ? alphabet[(group >> 6) & 0x3f] : '=';
+            out += i + 2 < bytes.size() ? alphabet[group & 0x3f] : '=';
+        }
+        return out;
+    }
+};
+
+} // namespace lect
@@ -7,11 +7,13 @@
 #pragma once
 
 #include "checks.hpp"
+#include "export.hpp"
 #include "preprocessing.hpp"
 #include "structures.hpp"
 #include <filesystem>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
 namespace lect {
 
@@ -36,6 +38,19 @@ Optional arguments:
               code annotations
   -lup <d>    Choose which nodes should be lined up
               (leaves, roots)
+  -json <p>   Write the found problems as a JSON
+              report to the path
+  -sarif <p>  Write the found problems as a SARIF
+              report to the path
+  -cache <p>  Keep the check results in the file and
+              only re-check changed annotations
+  -format <f> Format of the exported annotations
+              (json, msgpack)
+  -gz <lvl>   Also write gzipped copies of the
+              exported files, compressed at the
+              level (1-9)
+  -shards     Load the contents of the annotations
+              only when they are displayed
   -h, --help  Help screen
 )del";
 
@@ -52,6 +67,10 @@ struct Settings {
     Language language{Language::placeholder()};
     std::unique_ptr<Checker> checker;
     PrepocessingBuilder preprocessing_builder;
+    std::optional<std::filesystem::path> json_report_path;
+    std::optional<std::filesystem::path> sarif_report_path;
+    std::optional<std::filesystem::path> cache_path;
+    ExportOptions export_options;
 
     /**
      * @brief Uses main() function's argc and argv arguments to construct a
@@ -63,9 +82,7 @@ struct Settings {
     //$settings-builder-src Settings builder method
     static std::unique_ptr<Settings> build_with_args(int argc, char **argv) {
         std::unique_ptr<Settings> settings{new Settings()};
-        settings->checker = std::make_unique<IdAllowedSymbolsChecker>();
-        settings->checker->add(std::make_unique<DuplicateChecker>());
-        settings->checker->add(std::make_unique<NonexistentChecker>());
+        settings->checker = std::make_unique<NonexistentChecker>();
         settings->checker->add(std::make_unique<CycleChecker>());
 
         int ptr = 1;
@@ -184,6 +201,66 @@ struct Settings {
                 }
                 settings->preprocessing_builder.set_lineup(dir);
 
+            } else if (arg == "-json") {
+                if (argc == ptr + 1) {
+                    throw Exception("Report path not supplied after " +
+                                    color_green + "'-json'" + color_reset);
+                }
+                settings->json_report_path = argv[ptr + 1];
+                ptr++;
+
+            } else if (arg == "-sarif") {
+                if (argc == ptr + 1) {
+                    throw Exception("Report path not supplied after " +
+                                    color_green + "'-sarif'" + color_reset);
+                }
+                settings->sarif_report_path = argv[ptr + 1];
+                ptr++;
+
+            } else if (arg == "-cache") {
+                if (argc == ptr + 1) {
+                    throw Exception("Cache path not supplied after " +
+                                    color_green + "'-cache'" + color_reset);
+                }
+                settings->cache_path = argv[ptr + 1];
+                ptr++;
+
+            } else if (arg == "-format") {
+                if (argc == ptr + 1) {
+                    throw Exception("Format not supplied after " + color_green +
+                                    "'-format'" + color_reset +
+                                    ".\nAvailable options: 'json', 'msgpack'");
+                }
+                std::string format = argv[ptr + 1];
+                ptr++;
+                if (format == "json") {
+                    settings->export_options.format = PayloadFormat::json;
+                } else if (format == "msgpack") {
+                    settings->export_options.format = PayloadFormat::msgpack;
+                } else {
+                    throw Exception("Unrecognised format: " + color_blue +
+                                    "'" + format + "'" + color_reset +
+                                    ".\nAvailable options: 'json', 'msgpack'");
+                }
+
+            } else if (arg == "-gz") {
+                if (argc == ptr + 1) {
+                    throw Exception("Compression level not supplied after " +
+                                    color_green + "'-gz'" + color_reset);
+                }
+                std::string level = argv[ptr + 1];
+                ptr++;
+                if (level.size() != 1 || level[0] < '1' || level[0] > '9') {
+                    throw Exception("Unrecognised compression level: " +
+                                    color_blue + "'" + level + "'" +
+                                    color_reset +
+                                    ".\nThe level has to be from 1 to 9");
+                }
+                settings->export_options.gzip_level = level[0] - '0';
+
+            } else if (arg == "-shards") {
+                settings->export_options.shards = true;
+
             } else if (arg == "-h" || arg == "--help") {
                 std::cout << help_string;
                 throw Exception("help");
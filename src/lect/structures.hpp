@@ -11,6 +11,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace lect {
@@ -65,17 +66,33 @@ struct TextAnnotation {
     std::string title;
     std::string content;
     std::vector<std::string> references;
+    std::string file;
+    std::vector<int> reference_lines;
 
     TextAnnotation(std::string id, std::string title, std::string content,
-                   std::vector<std::string> references)
-        : id(id), title(title), content(content), references(references) {}
+                   std::vector<std::string> references, std::string file = "",
+                   std::vector<int> reference_lines = {})
+        : id(id), title(title), content(content), references(references),
+          file(file), reference_lines(reference_lines) {}
 
     TextAnnotation() {}
 };
 
+/**
+ * @class Highlight
+ * @brief A syntax-highlighted range of the content of a code annotation
+ *
+ */
+struct Highlight {
+    uint32_t start;
+    uint32_t end;
+    std::string kind;
+};
+
 /**
  * @class CodeAnnotation
- * @brief A representation of a code annotation and its position in the source
+ * @brief A representation of a code annotation and its position in the source.
+ * The highlights are sorted and don't overlap
  *
  */
 struct CodeAnnotation {
@@ -84,10 +101,13 @@ struct CodeAnnotation {
     std::string content;
     std::string file;
     int line;
+    std::vector<Highlight> highlights;
 
     CodeAnnotation(std::string id, std::string title, std::string content,
-                   std::string file, int line)
-        : id(id), title(title), content(content), file(file), line(line) {}
+                   std::string file, int line,
+                   std::vector<Highlight> highlights = {})
+        : id(id), title(title), content(content), file(file), line(line),
+          highlights(std::move(highlights)) {}
 };
 
 /**
@@ -235,6 +255,7 @@ struct Language {
     std::string name;
     std::vector<std::string> extensions;
     std::string query;
+    std::string highlights;
     const TSLanguage *language{nullptr};
     std::unique_ptr<CaptureValidator> validator{nullptr};
 
@@ -248,7 +269,7 @@ struct Language {
         std::vector<std::string> extensions{".c", ".cpp", ".h", ".hpp"};
         return Language("c++", extensions,
                         "((comment) @comment . (comment)* . (_) @object)",
-                        tree_sitter_cpp(),
+                        cpp_highlights, tree_sitter_cpp(),
                         std::make_unique<CSyntaxValidator>());
     }
 
@@ -259,25 +280,63 @@ struct Language {
      */
     //$language-placeholder-src Language placeholder
     static Language placeholder() {
-        return Language("", std::vector<std::string>(), "", nullptr, nullptr);
+        return Language("", std::vector<std::string>(), "", "", nullptr,
+                        nullptr);
     }
 
   private:
+    /**
+     * @brief Highlights query for C++. Capture names are the classes of the
+     * highlighted ranges in the viewer. When captures overlap, the outermost
+     * one wins, and of equal ones the one of the earlier pattern
+     */
+    static constexpr const char *cpp_highlights = R"query(
+(comment) @comment
+[(string_literal) (raw_string_literal) (char_literal) (system_lib_string)]
+  @string
+(number_literal) @number
+[(true) (false) (null) (this)] @constant
+[(primitive_type) (sized_type_specifier) (auto) (type_identifier)] @type
+(namespace_identifier) @namespace
+(call_expression function: (identifier) @function)
+(call_expression function: (field_expression field: (field_identifier)
+  @function))
+(call_expression function: (qualified_identifier name: (identifier)
+  @function))
+(function_declarator declarator: (identifier) @function)
+(function_declarator declarator: (field_identifier) @function)
+(field_identifier) @property
+(preproc_directive) @preprocessor
+["#define" "#elif" "#else" "#endif" "#if" "#ifdef" "#ifndef" "#include"]
+  @preprocessor
+["break" "case" "catch" "class" "co_await" "co_return" "co_yield" "concept"
+ "const" "consteval" "constexpr" "constinit" "continue" "decltype" "default"
+ "delete" "do" "else" "enum" "explicit" "extern" "final" "for" "friend" "goto"
+ "if" "inline" "mutable" "namespace" "new" "noexcept" "operator" "override"
+ "private" "protected" "public" "requires" "return" "sizeof" "static"
+ "static_assert" "struct" "switch" "template" "thread_local" "throw" "try"
+ "typedef" "typename" "union" "using" "virtual" "volatile" "while"] @keyword
+)query";
+
     /**
      * @brief The constructor for the language.
      *
      * @param name Name of the language
      * @param extensions File extensions for the languages
      * @param query Query for the data
+     * @param highlights Query for the syntax highlighting of the code
+     * annotations, empty to leave them unhighlighted
      * @param language Language object for parsing
      * appropriate comment
      * @param validator Validator object that can be used to validate captures
      * a comment
      */
     Language(const std::string name, const std::vector<std::string> &extensions,
-             const std::string query, const TSLanguage *language,
+             const std::string query, const std::string highlights,
+             const TSLanguage *language,
              std::unique_ptr<CaptureValidator> validator)
-        : name(name), extensions(extensions), query(query), language(language),
+        : name(name), extensions(extensions), query(query),
+          highlights(highlights), language(language),
           validator(std::move(validator)) {}
 };
 
@@ -1,21 +1,25 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include "checks.hpp"
+#include "diagnostics.hpp"
 #include "export.hpp"
 #include "extract.hpp"
-#include "nlohmann/json_fwd.hpp"
+#include "graph.hpp"
+#include "incremental.hpp"
+#include "preprocessing.hpp"
 #include "settings.hpp"
 #include "structures.hpp"
 #include "vis_js.hpp"
 
-int main(int argc, char **argv) {
-
-    // We'll need this one
-    assert(std::string(vis_js).size() == 688913);
+// We'll need this one
+static_assert(vis_js.size() == 688913,
+              "vis-network.min.js has to be embedded whole");
 
+int main(int argc, char **argv) {
     std::unique_ptr<lect::Settings> settings;
     try {
         settings = lect::Settings::build_with_args(argc, argv);
@@ -28,30 +32,52 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    lect::Diagnostics diagnostics;
     lect::Annotations annotations;
     try {
-        annotations = lect::AnnotationsBuilder()
+        annotations = lect::AnnotationsBuilder(diagnostics)
             .extract_text_annotations(settings->text_annotation_path)
             .extract_code_annotations(settings->code_annotation_path, settings->language)
             .get_annotations();
     } catch (lect::Exception e) {
-        if (true) {
-            return 1;
-        }
+        diagnostics.add(lect::Diagnostic("extract", e.what()));
     }
 
+    lect::AnnotationGraph graph = lect::AnnotationGraph::build(annotations);
+
     try {
-        settings->checker->check(annotations);
+        if (settings->cache_path.has_value()) {
+            auto state = lect::ValidationState::load(*settings->cache_path);
+            state.check(*settings->checker, annotations, graph, diagnostics);
+            state.save(*settings->cache_path);
+        } else {
+            settings->checker->check(annotations, graph, diagnostics);
+        }
+        if (settings->json_report_path.has_value()) {
+            lect::Diagnostics::write_report(*settings->json_report_path,
+                                            diagnostics.to_json());
+        }
+        if (settings->sarif_report_path.has_value()) {
+            lect::Diagnostics::write_report(*settings->sarif_report_path,
+                                            diagnostics.to_sarif());
+        }
     } catch (lect::Exception e) {
         std::cout << lect::color_red + "ERROR: " + lect::color_reset + e.what()
                   << "\n";
         return 1;
     }
 
-    nlohmann::json dict = settings->preprocessing_builder.build().preprocess(annotations);
+    if (!diagnostics.empty()) {
+        std::cout << diagnostics.to_text();
+        return 1;
+    }
+
+    lect::Payload payload = settings->preprocessing_builder.build().preprocess(
+        std::move(annotations), graph);
 
     try {
-        lect::export_to_dir(settings->output_path, dict);
+        lect::export_to_dir(settings->output_path, payload,
+                           settings->export_options);
     } catch (lect::Exception e) {
         std::cout << lect::color_red + "ERROR: " + lect::color_reset + e.what()
                   << "\n";